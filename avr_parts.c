@@ -0,0 +1,133 @@
+#include "avr_parts.h"
+
+#include <string.h>
+
+
+/*
+ * ********************************************************************
+ * Templates are written as compile_memory_cmd() would produce them,
+ * so no pattern has to be parsed at run time. test/check_avr_parts
+ * compares them with compiled datasheet patterns.
+ * ********************************************************************
+ */
+#define BIT_RUN(src, dst, bits)     {(src), (dst), (_u16)((1UL << (bits)) - 1)}
+
+#define CMD(op)                     {.base = (_u32)(op) << 24}
+
+#define CMD_ADDR(op, src, dst, bits)                                    \
+    {                                                                   \
+        .base = (_u32)(op) << 24,                                       \
+        .addr_runs_num = 1, .addr_runs = {BIT_RUN(src, dst, bits)}      \
+    }
+
+#define CMD_ADDR_INPUT(op, src, dst, bits)                              \
+    {                                                                   \
+        .base = (_u32)(op) << 24,                                       \
+        .addr_runs_num = 1, .addr_runs = {BIT_RUN(src, dst, bits)},     \
+        .input_runs_num = 1, .input_runs = {BIT_RUN(0, 0, 8)}           \
+    }
+
+
+/* Instructions address 64K words, the rest goes by Load Extended Address */
+#define WORD_ADDR_BITS(bits)        ((bits) > 16 ? 16 : (bits))
+
+/*
+ * Serial programming instruction set shared by ATmega and ATtiny
+ * parts. Sizes are given as log2 of flash words, flash page words,
+ * EEPROM bytes and EEPROM page bytes. Parts without EEPROM page
+ * mode have zero EEPROM page size.
+ *
+ * Clock of the target depends on its board and fuses, so it is left
+ * unknown and SPI keeps its start rate. Host sends fck with SelectPart
+ * to let the rate be raised.
+ */
+#define AVR_INFO(flash_bits, page_bits, eeprom_bits, eeprom_page_bits,             \
+                 flash_ms, eeprom_ms, rdy_bsy)                                      \
+    {                                                                               \
+        .flash_load_lo = CMD_ADDR_INPUT(0x40, 0, 8, page_bits),                     \
+        .flash_load_hi = CMD_ADDR_INPUT(0x48, 0, 8, page_bits),                     \
+        .flash_read_lo = CMD_ADDR(0x20, 0, 8, WORD_ADDR_BITS(flash_bits)),          \
+        .flash_read_hi = CMD_ADDR(0x28, 0, 8, WORD_ADDR_BITS(flash_bits)),          \
+        .flash_write_page = CMD_ADDR(0x4C, page_bits, 8 + (page_bits),              \
+                                     WORD_ADDR_BITS(flash_bits) - (page_bits)),     \
+        .flash_wait_ms = (flash_ms),                                                \
+        .flash_page_size = 1 << (page_bits),                                        \
+        .eeprom_write = CMD_ADDR_INPUT(0xC0, 0, 8, eeprom_bits),                    \
+        .eeprom_read = CMD_ADDR(0xA0, 0, 8, eeprom_bits),                           \
+        .eeprom_wait_ms = (eeprom_ms),                                              \
+        .pgm_enable = {0xAC, 0x53, 0x00, 0x00},                                     \
+        .rdy_bsy_supported = (rdy_bsy),                                             \
+        .poll_rdy_bsy = CMD(0xF0),                                                  \
+        .fck_khz = 0,                                                               \
+        .ext_addr_supported = ((flash_bits) > 16),                                  \
+        .load_ext_addr = CMD_ADDR(0x4D, 16, 8, 8),                                  \
+        .eeprom_page_size = (eeprom_page_bits) ? 1 << (eeprom_page_bits) : 0,       \
+        .eeprom_load_page = CMD_ADDR_INPUT(0xC1, 0, 8, eeprom_page_bits),           \
+        .eeprom_write_page = CMD_ADDR(0xC2, eeprom_page_bits, 8 + (eeprom_page_bits), \
+                                      (eeprom_bits) - (eeprom_page_bits))           \
+    }
+
+/* Low and high fuse bytes are fully implemented on all parts */
+#define AVR_PART(s0, s1, s2, part_name, flash_bits, page_bits, eeprom_bits,        \
+                 eeprom_page_bits, flash_ms, eeprom_ms, rdy_bsy, lock_bits, ext_bits) \
+    {                                                                               \
+        .signature = {(s0), (s1), (s2)},                                            \
+        .name = (part_name),                                                        \
+        .flash_size = (1UL << (flash_bits)) * AVR_WORD_SIZE,                        \
+        .eeprom_size = 1 << (eeprom_bits),                                          \
+        .info = AVR_INFO(flash_bits, page_bits, eeprom_bits, eeprom_page_bits,      \
+                         flash_ms, eeprom_ms, rdy_bsy),                             \
+        .fuse_bits = {                                                              \
+            [AVR_FUSE_LOCK] = (lock_bits),                                          \
+            [AVR_FUSE_LOW]  = 0xFF,                                                 \
+            [AVR_FUSE_HIGH] = 0xFF,                                                 \
+            [AVR_FUSE_EXT]  = (ext_bits)                                            \
+        }                                                                           \
+    }
+
+
+/*
+ * Write delays are datasheet tWD values rounded up. EEPROM page write takes as long as byte one.
+ * Parts without extended fuse byte have no extended bits.
+ */
+static const AvrPart avr_parts[] = {
+    AVR_PART(0x1E, 0x92, 0x0A, "ATmega48P",   11, 5,  8, 2, 5, 4, TRUE,  0x3F, 0x01),
+    AVR_PART(0x1E, 0x93, 0x0F, "ATmega88P",   12, 5,  9, 2, 5, 4, TRUE,  0x3F, 0x07),
+    AVR_PART(0x1E, 0x94, 0x0B, "ATmega168P",  13, 6,  9, 2, 5, 4, TRUE,  0x3F, 0x07),
+    AVR_PART(0x1E, 0x95, 0x0F, "ATmega328P",  14, 6, 10, 2, 5, 4, TRUE,  0x3F, 0x07),
+    AVR_PART(0x1E, 0x95, 0x14, "ATmega328",   14, 6, 10, 2, 5, 4, TRUE,  0x3F, 0x07),
+    AVR_PART(0x1E, 0x93, 0x07, "ATmega8",     12, 5,  9, 0, 5, 9, FALSE, 0x3F, 0x00),
+    AVR_PART(0x1E, 0x94, 0x03, "ATmega16",    13, 6,  9, 0, 5, 9, TRUE,  0x3F, 0x00),
+    AVR_PART(0x1E, 0x95, 0x02, "ATmega32",    14, 6, 10, 0, 5, 9, TRUE,  0x3F, 0x00),
+    AVR_PART(0x1E, 0x95, 0x87, "ATmega32U4",  14, 6, 10, 2, 5, 9, TRUE,  0x3F, 0x0F),
+    AVR_PART(0x1E, 0x96, 0x0A, "ATmega644P",  15, 7, 11, 3, 5, 4, TRUE,  0x3F, 0x07),
+    AVR_PART(0x1E, 0x97, 0x05, "ATmega1284P", 16, 7, 12, 3, 5, 4, TRUE,  0x3F, 0x07),
+    AVR_PART(0x1E, 0x97, 0x03, "ATmega1280",  16, 7, 12, 3, 5, 9, TRUE,  0x3F, 0x07),
+    AVR_PART(0x1E, 0x98, 0x01, "ATmega2560",  17, 7, 12, 3, 5, 9, TRUE,  0x3F, 0x07),
+    AVR_PART(0x1E, 0x91, 0x0A, "ATtiny2313",  10, 4,  7, 2, 5, 4, TRUE,  0x03, 0x01),
+    AVR_PART(0x1E, 0x92, 0x06, "ATtiny45",    11, 5,  8, 2, 5, 4, TRUE,  0x03, 0x01),
+    AVR_PART(0x1E, 0x93, 0x0B, "ATtiny85",    12, 5,  9, 2, 5, 4, TRUE,  0x03, 0x01),
+};
+
+#define AVR_PARTS_NUM   (sizeof(avr_parts)/sizeof(avr_parts[0]))
+
+
+const AvrPart* avr_parts_find(const _u8 *signature) {
+    for(_u16 i=0; i<AVR_PARTS_NUM; i++) {
+        if(memcmp(avr_parts[i].signature, signature, MCU_SIGNATURE_SIZE) == 0) {
+            return &avr_parts[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/* NULL past the last part */
+const AvrPart* avr_parts_get(_u16 index) {
+    if(index >= AVR_PARTS_NUM) {
+        return NULL;
+    }
+
+    return &avr_parts[index];
+}
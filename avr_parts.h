@@ -0,0 +1,30 @@
+#ifndef AVR_PARTS_H_INCLUDED
+#define AVR_PARTS_H_INCLUDED
+
+#include "simplelink.h"
+
+#include "programmer_config.h"
+#include "programmer_parser.h"
+
+
+/* Part known without LoadMCUInfo */
+typedef struct {
+    _u8         signature[MCU_SIGNATURE_SIZE];
+    const char  *name;
+
+    /* Sizes in bytes */
+    _u32        flash_size;
+    _u16        eeprom_size;
+
+    AvrMcuInfo  info;
+
+    /* Implemented fuse and lock bits by AvrFuse. The others read as 1. */
+    _u8         fuse_bits[AVR_FUSES_NUM];
+} AvrPart;
+
+
+const AvrPart*  avr_parts_find(const _u8 *signature);
+const AvrPart*  avr_parts_get(_u16 index);
+
+
+#endif // AVR_PARTS_H_INCLUDED
@@ -12,12 +12,7 @@
 #define INIT_TASK_NAME              "InitializationTask"
 #define INIT_TASK_PRIORITY          3
 
-/* LISTENING TASK */
-#define LISTENING_TASK_STACK_SIZE   1024
-#define LISTENING_TASK_NAME         "ListeningTask"
-#define LISTENING_TASK_PRIORITY     2
-
-/* Packet handling task */
+/* Packet handling task. Accepts connections too. */
 #define HANDLING_TASK_STACK_SIZE    2048
 #define HANDLING_TASK_NAME          "ControllerTask"
 #define HANDLING_TASK_PRIORITY      2
@@ -44,6 +39,9 @@
 #define PROGRAMMER_TASK_NAME        "ProgrammerTask"
 #define PROGRAMMER_TASK_PRIO        2
 
+/* Programmer packets being received and written at a time */
+#define PROGRAMMER_SLOTS            2
+
 /* Network parameters */
 #define SSID_NAME                   "ChtoZaSet"
 #define SSID_PWD                    "GrEs4242SeRg"
@@ -57,6 +55,12 @@
 #define TCP_LISTENING_PORT          1000
 #define TCP_LISTENING_ADDR          0x00
 
+/* Queued frames are sent together up to TCP MSS over WLAN */
+#define TCP_TX_COALESCE_SIZE        1460
+
+/* Loopback UDP port waking packet handling task */
+#define HANDLER_WAKE_PORT           1001
+
 /* Maximum in/out messages in queue */
 #define MSG_QUEUE_SIZE              5
 #define MSG_POOL_SIZE               (2*MSG_QUEUE_SIZE)
@@ -65,11 +69,47 @@
 #define MSG_QUEUE_WRITE_WAIT_MS     5
 
 #define PROG_SPI_BASE               GSPI_BASE
-#define PROG_SPI_DEFAULT_FREQ       100000
+#define PROG_SPI_DEFAULT_FREQ       400000
+#define PROG_SPI_MAX_FREQ           8000000
+
+/* GSPI interrupt signals DMA completion, so it must be allowed to call kernel */
+#define PROG_SPI_INT                INT_GSPI
+#define PROG_SPI_INT_PRIORITY       INT_PRIORITY_LVL_1
 
 #define ENTER_PGM_ATTEMPS           10
 
+/* Maximum ProgramMemory packets host may send without waiting for ACK */
+#define PROGRAM_WINDOW_MAX          8
+
+/* Largest image which can be staged in serial flash */
+#define IMAGE_STORE_MAX_SIZE        (256*1024)
+
+/* Image is read from serial flash and programmed by chunks of this size */
+#define IMAGE_CHUNK_SIZE            1024
+
+/*
+ * Compressed ProgramMemory data must not unpack to more than this.
+ * LZ4 matches may refer to any earlier output of the block, so the
+ * whole block is unpacked at once rather than streamed by pages.
+ */
+#define PROGRAM_UNPACKED_MAX_SIZE   4096
+
+/* Intel HEX data is gathered into pages up to this size. Power of two. */
+#define HEX_PAGE_MAX_SIZE           512
+
 
 #define MCU_RESET_PIN               PIN_61
 
+/*
+ * Gang programming. Targets share SCK and MOSI so every instruction
+ * reaches all of them. Each one has its own reset line and a select
+ * line enabling its MISO buffer. Target 0 resets by MCU_RESET_PIN.
+ * Pins and GPIO numbers go in the same order.
+ */
+#define GANG_MAX_TARGETS            4
+#define GANG_RESET_PINS             {PIN_61, PIN_62, PIN_63, PIN_53}
+#define GANG_RESET_GPIOS            {6, 7, 8, 30}
+#define GANG_SELECT_PINS            {PIN_03, PIN_04, PIN_15, PIN_18}
+#define GANG_SELECT_GPIOS           {12, 13, 22, 28}
+
 #endif // CONFIG_H_INCLUDED
@@ -4,6 +4,12 @@
 #include "packet_manager.h"
 
 #include "programmer.h"
+#include "image_store.h"
+#include "mcu_cache.h"
+#include "avr_parts.h"
+#include "crc.h"
+#include "ihex.h"
+#include "lz4.h"
 #include "sys.h"
 #include "config.h"
 
@@ -27,6 +33,103 @@ static _i16 process_load_mcu_info_packet(OsiMsgQ_t *out_queue, Packet *packet);
 static _i16 process_cmd_packet(OsiMsgQ_t *out_queue, Packet *packet);
 static _i16 process_program_memory_packet(OsiMsgQ_t *out_queue, Packet *packet);
 static _i16 process_read_memory_packet(OsiMsgQ_t *out_queue, Packet *packet);
+static _i16 process_program_window_packet(OsiMsgQ_t *out_queue, Packet *packet);
+static _i16 process_windowed_program_packet(OsiMsgQ_t *out_queue, Packet *packet);
+static _i16 process_image_begin_packet(OsiMsgQ_t *out_queue, Packet *packet);
+static _i16 process_image_data_packet(OsiMsgQ_t *out_queue, Packet *packet);
+static _i16 process_program_image_packet(OsiMsgQ_t *out_queue, Packet *packet);
+static _i16 process_chip_erase_packet(OsiMsgQ_t *out_queue, Packet *packet);
+static _i16 process_page_crc_request_packet(OsiMsgQ_t *out_queue, Packet *packet);
+static _i16 process_select_part_packet(OsiMsgQ_t *out_queue, Packet *packet);
+static _i16 process_verify_packet(OsiMsgQ_t *out_queue, Packet *packet);
+static _i16 process_fuses_packet(OsiMsgQ_t *out_queue, Packet *packet);
+static _i16 process_program_hex_packet(OsiMsgQ_t *out_queue, Packet *packet);
+static _i16 hex_stream_begin(AvrMemoryType memory_type);
+static _i16 hex_data_received(void *ctx, _u32 address, const _u8 *data, _u8 len);
+static _i16 flush_hex_page(void);
+static _i16 get_program_data(Packet *packet, _u16 offset, AvrProgMemData *mem_data);
+static inline _u32 get_u32(_u8 *buf);
+static _i16 enter_pgm_mode(_u8 *signature);
+static inline void put_u32(_u8 *buf, _u32 value);
+static _i16 check_mcu_info(OsiMsgQ_t *out_queue);
+static _i16 send_program_ack(_u8 ack_status);
+static _i16 flush_program_acks(void);
+static _i16 stream_next_chunk(void);
+static inline _u8 needs_programmer_task(const PacketHeader *header);
+
+static void programmer_task(void *pvParameters);
+
+
+/* Memory read which is sent as a sequence of chunks */
+typedef struct {
+    volatile _u8    active;
+    _u16            seq;
+    AvrReadMemData  mem_data;
+    OsiMsgQ_t       *out_queue;
+} ReadStream;
+
+static ReadStream read_stream = {.active = FALSE};
+
+
+/* ProgramMemory packets which may be in flight before ACK */
+typedef struct {
+    _u8             size;
+    _u8             failed;
+    _u16            expected_seq;
+    _u16            acked_seq;
+    OsiMsgQ_t       *out_queue;
+} ProgramWindow;
+
+static ProgramWindow program_window = {.size = 0};
+
+
+/* Programmer packet handed over to programmer task */
+typedef struct {
+    Packet          *packet;
+    OsiMsgQ_t       *out_queue;
+} ProgrammerJob;
+
+static ProgrammerJob    jobs[PROGRAMMER_SLOTS];
+static OsiMsgQ_t        jobs_queue;
+static OsiTaskHandle    programmer_task_hndl;
+
+/* Each counter is written by one task only: handling and programmer */
+static volatile _u32    jobs_queued = 0;
+static volatile _u32    jobs_done = 0;
+
+/* Chunk of stored image being programmed */
+static _u8              image_chunk[IMAGE_CHUNK_SIZE];
+
+/* CRCs of flash pages requested by host */
+static _u32             page_crcs[PL_PAGE_CRC_MAX_PAGES];
+
+/* Memory data of compressed ProgramMemory packet */
+static _u8              unpacked_data[PROGRAM_UNPACKED_MAX_SIZE];
+
+/* MCU info being loaded. Programmer keeps its own copy. */
+static AvrMcuInfo       mcu_info;
+
+
+/*
+ * Intel HEX stream. Data is gathered into page buffer and programmed
+ * when it moves to another page. Touched part of page is [lo, hi).
+ * Flash page can not be written again without erase, so flash records
+ * must come in ascending pages. Stream fails when they go below
+ * next_page, which follows the last programmed page.
+ */
+typedef struct {
+    _u8             active;
+    AvrMemoryType   memory_type;
+    IhexParser      parser;
+    _u32            page_address;
+    _u32            next_page;
+    _u16            page_size;
+    _u16            lo;
+    _u16            hi;
+    _u8             page[HEX_PAGE_MAX_SIZE];
+} HexStream;
+
+static HexStream hex_stream = {.active = FALSE};
 
 
 /* Mapping from packet type to corresponding handler */
@@ -47,31 +150,208 @@ static PacketHandler packet_handlers[PacketsNumber] = {
     [ProgramMemoryPacket] = process_program_memory_packet,
     [ReadMemoryPacket] = process_read_memory_packet,
     [MemoryPacket] = NULL,  // Do not receive it
-    [CMDPacket] = process_cmd_packet
+    [CMDPacket] = process_cmd_packet,
+    [ProgramWindowPacket] = process_program_window_packet,
+    [ProgramAckPacket] = NULL,  // Do not receive it
+    [ImageBeginPacket] = process_image_begin_packet,
+    [ImageDataPacket] = process_image_data_packet,
+    [ProgramImagePacket] = process_program_image_packet,
+    [ChipErasePacket] = process_chip_erase_packet,
+    [PageCrcRequestPacket] = process_page_crc_request_packet,
+    [PageCrcPacket] = NULL,  // Do not receive it
+    [SelectPartPacket] = process_select_part_packet,
+    [VerifyPacket] = process_verify_packet,
+    [FusesPacket] = process_fuses_packet,
+    [ProgramHexPacket] = process_program_hex_packet
 };
 
 
 
+_i16 controller_start(void) {
+    _i16 status;
+
+    crc32_init();
+
+    status = osi_MsgQCreate(&jobs_queue, "ProgrammerJobs", sizeof(ProgrammerJob*), PROGRAMMER_SLOTS);
+    OSI_ASSERT_ON_ERROR(status);
+
+    status = osi_TaskCreate(programmer_task, PROGRAMMER_TASK_NAME, PROGRAMMER_TASK_STACK_SIZE,
+                            NULL, PROGRAMMER_TASK_PRIO, &programmer_task_hndl);
+    OSI_ASSERT_ON_ERROR(status);
+
+    return status;
+}
+
+
+/*
+ * ************************************************************
+ * Processes control packets in place. Programmer packets are
+ * handed over to programmer task together with ownership, in
+ * which case CONTROLLER_PACKET_TAKEN is returned and caller
+ * must not release packet.
+ * ************************************************************
+ */
 _i16 process_packet(OsiMsgQ_t *out_queue, Packet *packet) {
     _i16 status;
     PacketHeader header = packet->header;
     print_packet(packet);
 
+    if(packet_handlers[header.type] == NULL) {
+        return -1;
+    }
+
+    if(needs_programmer_task(&header)) {
+        ProgrammerJob *job = &jobs[jobs_queued % PROGRAMMER_SLOTS];
+
+        if(controller_busy()) {
+            return -1;
+        }
+
+        job->packet = packet;
+        job->out_queue = out_queue;
+
+        status = sys_queue_write_ptr(&jobs_queue, job, 0);
+        OSI_ASSERT_ON_ERROR(status);
+
+        jobs_queued++;
+        return CONTROLLER_PACKET_TAKEN;
+    }
+
     status = packet_handlers[header.type](out_queue, packet);
 
     return status;
 }
 
 
+/* Both slots are taken so no more programmer packets can be received */
+_u8 controller_busy(void) {
+    return (jobs_queued - jobs_done) >= PROGRAMMER_SLOTS;
+}
+
+
+/* Packet can be processed now or has to wait in connection */
+_u8 controller_ready(const PacketHeader *header) {
+    return !needs_programmer_task(header) || !controller_busy();
+}
+
+
+/* Programmer init enters PGM mode so it needs programmer task too */
+static inline _u8 needs_programmer_task(const PacketHeader *header) {
+    return header->group == ProgrammerGroup || header->type == ProgrammerInitPacket;
+}
+
+
+/*
+ * ************************************************************
+ * Runs programmer packets. While one slot is being written
+ * into MCU the handling task receives packet into the other.
+ * ************************************************************
+ */
+static void programmer_task(void *pvParameters) {
+    (void)pvParameters;
+    _i16 status;
+    ProgrammerJob *job;
+
+    for( ;; ) {
+        status = sys_queue_read_ptr(&jobs_queue, (void**)&job, OSI_WAIT_FOREVER);
+        if(status < 0) {
+            continue;
+        }
+
+        packet_handlers[job->packet->header.type](job->out_queue, job->packet);
+
+        release_packet(job->packet);
+        jobs_done++;
+
+        /* Slot and packet are free, packet waiting in connection may go */
+        packet_handler_wake();
+
+        while(read_stream.active) {
+            stream_next_chunk();
+        }
+
+        /* Nothing more has been received while programming */
+        if(jobs_queued == jobs_done) {
+            flush_program_acks();
+        }
+    }
+}
+
+
 
 /*************************** CONTROL PACKETS ********************************/
 /**                                                                        **/
 /****************************************************************************/
-_i16 process_prog_init(OsiMsgQ_t *out_queue, Packet *packet) {
+/*
+ * ************************************************************
+ * Enters PGM mode with generic Programming Enable and reads
+ * signature of the target. MCU info compiled for this signature
+ * is taken from serial flash cache or built-in part table.
+ *
+ * Mask of gang targets may be given, all of them must have the
+ * same signature. Following packets are applied to all targets.
+ *
+ * ACK tells whether host still has to load MCU info.
+ * ************************************************************
+ */
+static _i16 process_prog_init(OsiMsgQ_t *out_queue, Packet *packet) {
     _i16 status;
+    _i32 rate = -1;
+    _u8 targets = 0x01;
+    _u8 ack_data[PL_PROG_INIT_ACK_SIZE] = {0};
+
+    if(packet->header.data_size >= PL_PROG_INIT_TARGETS_SIZE) {
+        targets = packet->packet_data[PL_PROG_INIT_TARGETS_OFFSET];
+    }
+
+    if(programmer_set_targets(targets) < 0) {
+        send_error("Wrong targets mask\r\n", out_queue);
+
+        status = send_ack(-1, out_queue);
+        SYS_ASSERT_CRITICAL(status);
+
+        return -1;
+    }
 
     /* Check for uart, save its' state and pause */
 
+    /* Info of the previous target must not be used */
+    programmer_set_mcu_info(NULL);
+    hex_stream.active = FALSE;
+
+    status = enter_pgm_mode(ack_data + PL_PROG_INIT_SIGN_OFFSET);
+
+    if(status < 0) {
+        send_error("Failed to enter PGM mode\r\n", out_queue);
+    }
+    else {
+        _u8 *signature = ack_data + PL_PROG_INIT_SIGN_OFFSET;
+        const AvrPart *part = avr_parts_find(signature);
+        _u8 found = TRUE;
+
+        if(mcu_cache_load(signature, &mcu_info) < 0) {
+            if(part != NULL) {
+                mcu_info = part->info;
+            }
+            else {
+                found = FALSE;
+            }
+        }
+
+        if(found) {
+            programmer_set_mcu_info(&mcu_info);
+
+            rate = programmer_ramp_spi_rate();
+            ack_data[PL_PROG_INIT_HIT_OFFSET] = (rate >= 0);
+        }
+    }
+
+    put_u32(ack_data + PL_PROG_INIT_RATE_OFFSET, (rate < 0) ? 0 : rate);
+    ack_data[PL_PROG_INIT_FAILED_OFFSET] = programmer_failed_targets();
+
+    status = send_ack_data(status, ack_data, sizeof ack_data, out_queue);
+    SYS_ASSERT_CRITICAL(status);
+
     return status;
 }
 
@@ -152,31 +432,153 @@ static _i16 process_cmd_packet(OsiMsgQ_t *out_queue, Packet *packet) {
 }
 
 
-static _i16 process_load_mcu_info_packet(OsiMsgQ_t *out_queue, Packet *packet) {
+/* Blank pages are skipped by following ProgramMemory packets */
+static _i16 process_chip_erase_packet(OsiMsgQ_t *out_queue, Packet *packet) {
+    (void)packet;
     _i16 status;
 
-    AvrMcuInfo *info = malloc(sizeof *info);
+    status = programmer_chip_erase();
+    if(status < 0) {
+        send_error("Failed to erase chip\r\n", out_queue);
+    }
+
+    status = send_ack(status, out_queue);
+    SYS_ASSERT_CRITICAL(status);
 
-    status = get_mcu_info(packet, info);
-    OSI_ASSERT_ON_ERROR(status);
+    return status;
+}
 
-    /* If previous info exists it will be freed automatically */
-    programmer_set_mcu_info(info);
 
-    for(int i=0; i<ENTER_PGM_ATTEMPS; i++) {
+/*
+ * Signature is read from the first target which has entered PGM
+ * mode. Gang targets with another signature are dropped.
+ */
+static _i16 enter_pgm_mode(_u8 *signature) {
+    _i16 status = -1;
+
+    for(int i=0; i<ENTER_PGM_ATTEMPS && status < 0; i++) {
         status = programmer_enable_pgm_mode();
+    }
 
-        if(status >= 0) {
-            break;
-        }
+    if(status >= 0) {
+        status = programmer_read_signature(signature);
+    }
+
+    if(status >= 0) {
+        status = programmer_match_signatures(signature);
+    }
+
+    return status;
+}
+
+
+/* Compiled info is cached under signature of the target */
+static _i16 process_load_mcu_info_packet(OsiMsgQ_t *out_queue, Packet *packet) {
+    _i16 status;
+    _i32 rate = -1;
+    _u8 signature[MCU_SIGNATURE_SIZE];
+    _u8 ack_data[PL_LOAD_MCU_ACK_SIZE];
+
+    status = get_mcu_info(packet, &mcu_info);
+    if(status < 0) {
+        /* Partly parsed info must not be used */
+        programmer_set_mcu_info(NULL);
+        send_error("Wrong MCU info\r\n", out_queue);
+
+        put_u32(ack_data + PL_LOAD_MCU_RATE_OFFSET, 0);
+        status = send_ack_data(-1, ack_data, sizeof ack_data, out_queue);
+        SYS_ASSERT_CRITICAL(status);
+
+        return -1;
     }
 
+    programmer_set_mcu_info(&mcu_info);
+
+    status = enter_pgm_mode(signature);
+
     if(status < 0) {
-        status = send_error("Failed to enter PGM mode\r\n", out_queue);
+        send_error("Failed to enter PGM mode\r\n", out_queue);
+    }
+    else {
+        if(mcu_cache_store(signature, &mcu_info) < 0) {
+            OSI_COMMON_LOG("Failed to cache MCU info\r\n");
+        }
+
+        rate = programmer_ramp_spi_rate();
+        status = (rate < 0) ? -1 : 0;
+    }
+
+    /* ACK carries SPI rate chosen for the target */
+    put_u32(ack_data + PL_LOAD_MCU_RATE_OFFSET, (rate < 0) ? 0 : rate);
+
+    status = send_ack_data(status, ack_data, sizeof ack_data, out_queue);
+    SYS_ASSERT_CRITICAL(status);
+
+    return status;
+}
+
+
+/*
+ * ************************************************************
+ * Takes MCU info from built-in part table instead of loading
+ * it. Signature of the target must match the requested one.
+ * Target clock may follow signature. Without it SPI rate is not
+ * raised, as part table does not know clock of the board.
+ * ************************************************************
+ */
+static _i16 process_select_part_packet(OsiMsgQ_t *out_queue, Packet *packet) {
+    _i16 status;
+    _i32 rate = -1;
+    _u8 *buf = packet->packet_data;
+    _u8 signature[MCU_SIGNATURE_SIZE];
+    _u8 ack_data[PL_LOAD_MCU_ACK_SIZE];
+    const AvrPart *part;
+
+    if(packet->header.data_size < PL_SELECT_PART_SIGN_SIZE) {
+        return -1;
+    }
+
+    part = avr_parts_find(buf + PL_SELECT_PART_SIGN_OFFSET);
+    if(part == NULL) {
+        send_error("Unknown part\r\n", out_queue);
+
+        status = send_ack(-1, out_queue);
         SYS_ASSERT_CRITICAL(status);
+
+        return -1;
     }
 
-    status = send_ack(status, out_queue);
+    mcu_info = part->info;
+
+    if(packet->header.data_size >= PL_SELECT_PART_FCK_OFFSET + 2) {
+        mcu_info.fck_khz = (buf[PL_SELECT_PART_FCK_OFFSET] << 8) |
+                           buf[PL_SELECT_PART_FCK_OFFSET+1];
+    }
+
+    programmer_set_mcu_info(&mcu_info);
+
+    status = enter_pgm_mode(signature);
+
+    if(status < 0) {
+        send_error("Failed to enter PGM mode\r\n", out_queue);
+    }
+    else if(memcmp(signature, part->signature, MCU_SIGNATURE_SIZE) != 0) {
+        /* Info of another part must not be used */
+        programmer_set_mcu_info(NULL);
+
+        send_error("Signature of target does not match\r\n", out_queue);
+        status = -1;
+    }
+    else {
+        OSI_COMMON_LOG("Selected %s\r\n", part->name);
+
+        rate = programmer_ramp_spi_rate();
+        status = (rate < 0) ? -1 : 0;
+    }
+
+    put_u32(ack_data + PL_LOAD_MCU_RATE_OFFSET, (rate < 0) ? 0 : rate);
+
+    status = send_ack_data(status, ack_data, sizeof ack_data, out_queue);
     SYS_ASSERT_CRITICAL(status);
 
     return status;
@@ -186,12 +588,15 @@ static _i16 process_load_mcu_info_packet(OsiMsgQ_t *out_queue, Packet *packet) {
 static _i16 process_program_memory_packet(OsiMsgQ_t *out_queue, Packet *packet) {
     _i16 status;
     AvrProgMemData mem_data;
-    _u8 pgm_cmd[4];
 
-    status = get_prog_mem_data(packet, &mem_data);
-    OSI_ASSERT_ON_ERROR(status);
+    if(program_window.size != 0) {
+        return process_windowed_program_packet(out_queue, packet);
+    }
 
-    status = programmer_program_memory(&mem_data);
+    status = get_program_data(packet, 0, &mem_data);
+    if(status >= 0) {
+        status = programmer_program_memory(&mem_data);
+    }
 
     if(status < 0) {
         send_error("Failed to program memory\r\n", out_queue);
@@ -205,6 +610,158 @@ static _i16 process_program_memory_packet(OsiMsgQ_t *out_queue, Packet *packet)
 }
 
 
+/*
+ * ************************************************************
+ * Host may compress memory data of any ProgramMemory packet.
+ * Address and memory type stay plain, data is unpacked into
+ * static buffer which mem_data points to afterwards.
+ * ************************************************************
+ */
+static _i16 get_program_data(Packet *packet, _u16 offset, AvrProgMemData *mem_data) {
+    _i16 status;
+    _i32 len;
+
+    status = get_prog_mem_data(packet, offset, mem_data);
+    if(status < 0 || !packet->header.compression) {
+        return status;
+    }
+
+    len = lz4_decompress_block(mem_data->data, mem_data->data_len,
+                               unpacked_data, sizeof unpacked_data);
+    if(len < 0) {
+        OSI_COMMON_LOG("Failed to unpack memory data\r\n");
+        return -1;
+    }
+
+    mem_data->data = unpacked_data;
+    mem_data->data_len = len;
+
+    return 0;
+}
+
+
+/*
+ * ************************************************************
+ * Negotiates number of ProgramMemory packets host may send
+ * without waiting for ACK. Granted window is sent in ACK.
+ * ************************************************************
+ */
+static _i16 process_program_window_packet(OsiMsgQ_t *out_queue, Packet *packet) {
+    _u8 window;
+
+    if(packet->header.data_size < PL_PROGRAM_WINDOW_OFFSET + 1) {
+        return -1;
+    }
+
+    window = packet->packet_data[PL_PROGRAM_WINDOW_OFFSET];
+    if(window > PROGRAM_WINDOW_MAX) {
+        window = PROGRAM_WINDOW_MAX;
+    }
+
+    program_window.size = window;
+    program_window.expected_seq = 0;
+    program_window.acked_seq = 0;
+    program_window.failed = FALSE;
+    program_window.out_queue = out_queue;
+
+    return send_ack_data(0, &window, 1, out_queue);
+}
+
+
+/*
+ * ************************************************************
+ * Programs packet of windowed stream.
+ *
+ * Successful packets are acknowledged cumulatively once half of
+ * window is consumed or host stops sending. Failed packet is
+ * reported at once with its sequence number and packets after
+ * it are dropped till host sends failed one again. Every dropped
+ * packet is answered with ACK of the expected sequence number,
+ * so host learns about loss without waiting for timeout.
+ * ************************************************************
+ */
+static _i16 process_windowed_program_packet(OsiMsgQ_t *out_queue, Packet *packet) {
+    _i16 status;
+    AvrProgMemData mem_data;
+    _u8 *buf = packet->packet_data;
+    _u16 seq;
+
+    if(packet->header.data_size < PL_PROGRAM_SEQ_SIZE) {
+        return -1;
+    }
+
+    seq = (buf[PL_PROGRAM_SEQ_OFFSET] << 8) | buf[PL_PROGRAM_SEQ_OFFSET+1];
+
+    /* Packets sent after the failed or lost one are dropped */
+    if(seq != program_window.expected_seq) {
+        status = send_program_ack(program_window.failed ? PL_ACK_FAILURE : PL_ACK_SUCCESS);
+        SYS_ASSERT_CRITICAL(status);
+
+        return 0;
+    }
+
+    program_window.failed = FALSE;
+
+    status = get_program_data(packet, PL_PROGRAM_SEQ_SIZE, &mem_data);
+    if(status >= 0) {
+        status = programmer_program_memory(&mem_data);
+    }
+
+    if(status < 0) {
+        program_window.failed = TRUE;
+
+        status = send_program_ack(PL_ACK_FAILURE);
+        SYS_ASSERT_CRITICAL(status);
+
+        return status;
+    }
+
+    program_window.expected_seq++;
+
+    if((_u16)(program_window.expected_seq - program_window.acked_seq) >=
+       (program_window.size + 1) / 2)
+    {
+        status = send_program_ack(PL_ACK_SUCCESS);
+        SYS_ASSERT_CRITICAL(status);
+    }
+
+    return status;
+}
+
+
+/* Acknowledges every packet before expected one */
+static _i16 send_program_ack(_u8 ack_status) {
+    _u8 data[PL_PROGRAM_ACK_SIZE];
+    _u16 seq = program_window.expected_seq;
+
+    data[PL_PROGRAM_ACK_STATUS_OFFSET] = ack_status;
+    data[PL_PROGRAM_ACK_SEQ_OFFSET] = (seq >> 8) & 0xFF;
+    data[PL_PROGRAM_ACK_SEQ_OFFSET+1] = seq & 0xFF;
+
+    program_window.acked_seq = seq;
+
+    return create_send_packet(ProgramAckPacket, data, PL_PROGRAM_ACK_SIZE,
+                              program_window.out_queue);
+}
+
+
+/*
+ * ************************************************************
+ * Called when host has nothing more in flight. Acknowledges
+ * packets programmed since the last ACK.
+ * ************************************************************
+ */
+static _i16 flush_program_acks(void) {
+    if(program_window.size == 0 || program_window.failed ||
+       program_window.acked_seq == program_window.expected_seq)
+    {
+        return 0;
+    }
+
+    return send_program_ack(PL_ACK_SUCCESS);
+}
+
+
 static _i16 process_read_memory_packet(OsiMsgQ_t *out_queue, Packet *packet) {
     _i16 status;
     AvrReadMemData mem_data;
@@ -212,21 +769,638 @@ static _i16 process_read_memory_packet(OsiMsgQ_t *out_queue, Packet *packet) {
     status = get_read_mem_data(packet, &mem_data);
     OSI_ASSERT_ON_ERROR(status);
 
-    /* Create packet by hands in order to avoid data copy */
-    Packet *memory_packet;
-    status = get_packet_from_pool(&memory_packet);
-    OSI_ASSERT_ON_ERROR(status);
+    if(check_mcu_info(out_queue) < 0) {
+        return -1;
+    }
+
+    /* Flash is read by words, the last chunk would fail otherwise */
+    if(mem_data.mem_t == MEMORY_FLASH && (mem_data.bytes_to_read % AVR_WORD_SIZE) != 0) {
+        send_error("Odd length of flash read\r\n", out_queue);
+
+        status = send_ack(-1, out_queue);
+        SYS_ASSERT_CRITICAL(status);
+
+        return -1;
+    }
+
+    if(read_stream.active) {
+        status = send_error("Read is already in progress\r\n", out_queue);
+        OSI_ASSERT_ON_ERROR(status);
+
+        return -1;
+    }
+
+    read_stream.mem_data = mem_data;
+    read_stream.out_queue = out_queue;
+    read_stream.seq = 0;
+    read_stream.active = (mem_data.bytes_to_read != 0);
+
+    /* Chunks are sent by programmer task */
+    return 0;
+}
+
+
+
+/*
+ * ************************************************************
+ * Starts upload of image into serial flash. Image is uploaded
+ * once and then may be programmed into any number of MCUs.
+ * ************************************************************
+ */
+static _i16 process_image_begin_packet(OsiMsgQ_t *out_queue, Packet *packet) {
+    _i16 status;
+    ImageInfo info;
+    _u8 *buf = packet->packet_data;
+
+    if(packet->header.data_size != PL_IMAGE_BEGIN_SIZE) {
+        return -1;
+    }
+
+    info.memory_type = get_memory_type(buf[PL_IMAGE_MEMORY_OFFSET]);
+    info.start_address = get_u32(buf + PL_IMAGE_ADDRESS_OFFSET);
+    info.length = get_u32(buf + PL_IMAGE_LENGTH_OFFSET);
+    info.crc = get_u32(buf + PL_IMAGE_CRC_OFFSET);
+
+    /* Flash is programmed by words, the last one would be half written */
+    if(info.memory_type == MEMORY_FLASH && (info.length % AVR_WORD_SIZE) != 0) {
+        send_error("Odd length of flash image\r\n", out_queue);
+
+        status = send_ack(-1, out_queue);
+        SYS_ASSERT_CRITICAL(status);
 
-    status = programmer_read_memory(&mem_data, memory_packet->packet_data);
+        return -1;
+    }
+
+    status = image_store_begin(&info);
     if(status < 0) {
-        status = send_error("Failed to read memory\r\n", out_queue);
+        send_error("Failed to create image file\r\n", out_queue);
+    }
+
+    status = send_ack(status, out_queue);
+    SYS_ASSERT_CRITICAL(status);
+
+    return status;
+}
+
+
+/* ACK of the last chunk also tells whether image CRC matches */
+static _i16 process_image_data_packet(OsiMsgQ_t *out_queue, Packet *packet) {
+    _i16 status;
+    _u8 *buf = packet->packet_data;
+    _u16 len = packet->header.data_size;
+
+    if(len < PL_IMAGE_DATA_OFFSET_SIZE) {
+        return -1;
+    }
+
+    status = image_store_write(get_u32(buf + PL_IMAGE_DATA_OFFSET_OFFSET),
+                               buf + PL_IMAGE_DATA_OFFSET_SIZE,
+                               len - PL_IMAGE_DATA_OFFSET_SIZE);
+
+    status = send_ack(status, out_queue);
+    SYS_ASSERT_CRITICAL(status);
+
+    return status;
+}
+
+
+/*
+ * ************************************************************
+ * Programs stored image into MCU. Image is read from serial
+ * flash by chunks and goes through the same page engine as
+ * ProgramMemory packets.
+ * ************************************************************
+ */
+static _i16 process_program_image_packet(OsiMsgQ_t *out_queue, Packet *packet) {
+    (void)packet;
+    _i16 status;
+    ImageInfo info;
+    AvrProgMemData mem_data;
+
+    status = image_store_open(&info);
+    if(status < 0) {
+        send_error("No valid image stored\r\n", out_queue);
+
+        status = send_ack(status, out_queue);
+        SYS_ASSERT_CRITICAL(status);
+
+        return -1;
+    }
+
+    mem_data.memory_type = info.memory_type;
+    mem_data.start_address = info.start_address;
+    mem_data.data = image_chunk;
+
+    for(_u32 offset=0; offset<info.length; offset+=mem_data.data_len) {
+        mem_data.data_len = IMAGE_CHUNK_SIZE;
+
+        if(info.length - offset < IMAGE_CHUNK_SIZE) {
+            mem_data.data_len = info.length - offset;
+        }
+
+        if(image_store_read(offset, image_chunk, mem_data.data_len) != mem_data.data_len) {
+            status = -1;
+            break;
+        }
+
+        status = programmer_program_memory(&mem_data);
+        if(status < 0) {
+            break;
+        }
+
+        /* Flash is addressed by words */
+        if(mem_data.memory_type == MEMORY_FLASH) {
+            mem_data.start_address += mem_data.data_len / AVR_WORD_SIZE;
+        }
+        else {
+            mem_data.start_address += mem_data.data_len;
+        }
+    }
+
+    image_store_close();
+
+    if(status < 0) {
+        send_error("Failed to program stored image\r\n", out_queue);
+    }
+
+    status = send_ack(status, out_queue);
+    SYS_ASSERT_CRITICAL(status);
+
+    return status;
+}
+
+
+/*
+ * ************************************************************
+ * Replies with CRC32 of every flash page in range so that host
+ * sends only pages which differ from the new image.
+ * ************************************************************
+ */
+static _i16 process_page_crc_request_packet(OsiMsgQ_t *out_queue, Packet *packet) {
+    _i16 status;
+    Packet *reply;
+    _u8 *buf = packet->packet_data;
+    _u32 address;
+    _u16 pages;
+
+    if(packet->header.data_size != PL_PAGE_CRC_REQUEST_SIZE) {
+        return -1;
+    }
+
+    if(check_mcu_info(out_queue) < 0) {
+        return -1;
+    }
+
+    address = get_u32(buf + PL_PAGE_CRC_ADDRESS_OFFSET);
+    pages = (buf[PL_PAGE_CRC_COUNT_OFFSET] << 8) | buf[PL_PAGE_CRC_COUNT_OFFSET+1];
+
+    if(pages > PL_PAGE_CRC_MAX_PAGES) {
+        status = send_error("Too many pages requested\r\n", out_queue);
         OSI_ASSERT_ON_ERROR(status);
+
+        return -1;
+    }
+
+    status = programmer_flash_page_crcs(address, pages, page_crcs);
+    if(status < 0) {
+        status = send_error("Failed to read flash pages\r\n", out_queue);
+        OSI_ASSERT_ON_ERROR(status);
+
+        return -1;
+    }
+
+    status = get_packet_from_pool(&reply);
+    OSI_ASSERT_ON_ERROR(status);
+
+    memcpy(reply->packet_data, buf, PL_PAGE_CRC_REQUEST_SIZE);
+
+    for(_u16 i=0; i<pages; i++) {
+        put_u32(reply->packet_data + PL_PAGE_CRC_DATA_OFFSET + i*4, page_crcs[i]);
+    }
+
+    return send_packet(reply, PageCrcPacket, PL_PAGE_CRC_DATA_OFFSET + pages*4, out_queue);
+}
+
+
+/*
+ * ************************************************************
+ * Checks memory range against CRC32 of image. Only the result
+ * is sent back: CRC of target memory and the first page which
+ * differs, if host has sent CRC of every page.
+ *
+ * Every gang target is checked separately and dropped if its
+ * memory differs.
+ * ************************************************************
+ */
+static _i16 process_verify_packet(OsiMsgQ_t *out_queue, Packet *packet) {
+    _i16 status;
+    _u8 *buf = packet->packet_data;
+    _u16 len = packet->header.data_size;
+    AvrReadMemData range;
+    _u32 crc = 0;
+    _u32 bad_page = PL_VERIFY_PAGE_UNKNOWN;
+    _u8 mismatch_found = FALSE;
+    _u16 pages_num;
+    _u8 ack_data[PL_VERIFY_ACK_SIZE];
+
+    if(len < PL_VERIFY_PAGES_OFFSET || (len - PL_VERIFY_PAGES_OFFSET) % 4 != 0) {
+        return -1;
+    }
+
+    pages_num = (len - PL_VERIFY_PAGES_OFFSET) / 4;
+    if(pages_num > PL_PAGE_CRC_MAX_PAGES) {
+        return -1;
+    }
+
+    /* Targets are not dropped for host not having loaded MCU info */
+    if(check_mcu_info(out_queue) < 0) {
+        return -1;
+    }
+
+    range.mem_t = get_memory_type(buf[PL_VERIFY_MEMORY_OFFSET]);
+    range.start_address = get_u32(buf + PL_VERIFY_ADDRESS_OFFSET);
+    range.bytes_to_read = get_u32(buf + PL_VERIFY_LENGTH_OFFSET);
+
+    for(_u8 t=0; t<GANG_MAX_TARGETS; t++) {
+        _u32 target_crc = 0;
+
+        if(programmer_select_target(t) < 0) {
+            continue;
+        }
+
+        status = programmer_memory_crc(&range, &target_crc,
+                                       pages_num ? page_crcs : NULL, pages_num);
+
+        if(status < 0) {
+            send_error("Failed to read memory\r\n", out_queue);
+            programmer_fail_target(t);
+        }
+        else if(target_crc != get_u32(buf + PL_VERIFY_CRC_OFFSET)) {
+            OSI_COMMON_LOG("Target %d differs from image\r\n", t);
+            programmer_fail_target(t);
+
+            if(!mismatch_found) {
+                mismatch_found = TRUE;
+                crc = target_crc;
+
+                for(_u16 i=0; i<pages_num; i++) {
+                    if(page_crcs[i] != get_u32(buf + PL_VERIFY_PAGES_OFFSET + i*4)) {
+                        bad_page = i;
+                        break;
+                    }
+                }
+            }
+        }
+        else if(!mismatch_found) {
+            crc = target_crc;
+        }
+    }
+
+    status = (programmer_failed_targets() != 0) ? -1 : 0;
+
+    put_u32(ack_data + PL_VERIFY_ACK_CRC_OFFSET, crc);
+    put_u32(ack_data + PL_VERIFY_ACK_PAGE_OFFSET, bad_page);
+    ack_data[PL_VERIFY_ACK_FAILED_OFFSET] = programmer_failed_targets();
+
+    status = send_ack_data(status, ack_data, sizeof ack_data, out_queue);
+    SYS_ASSERT_CRITICAL(status);
+
+    return status;
+}
+
+
+/*
+ * ************************************************************
+ * Reads signature, calibration, lock and fuse bytes at once.
+ * Write request also writes selected bytes before reading, and
+ * the ones which were not read back as written are reported.
+ * ************************************************************
+ */
+static _i16 process_fuses_packet(OsiMsgQ_t *out_queue, Packet *packet) {
+    _i16 status = 0;
+    _u8 *buf = packet->packet_data;
+    _u16 len = packet->header.data_size;
+    _u8 mask = 0;
+    _u8 failed = 0;
+    AvrFuseData fuses;
+    _u8 ack_data[PL_FUSES_ACK_SIZE];
+
+    if(len != 0 && len != PL_FUSES_WRITE_SIZE) {
+        return -1;
+    }
+
+    if(len == PL_FUSES_WRITE_SIZE) {
+        mask = buf[PL_FUSES_MASK_OFFSET] & ((1 << AVR_FUSES_NUM) - 1);
+    }
+
+    if(mask) {
+        status = programmer_write_fuses(mask, buf + PL_FUSES_VALUES_OFFSET, &failed);
+    }
+
+    if(programmer_read_fuses(&fuses) < 0) {
+        send_error("Failed to read fuses\r\n", out_queue);
+        status = -1;
+        memset(&fuses, 0, sizeof fuses);
+        failed = mask;
+    }
+
+    memcpy(ack_data + PL_FUSES_ACK_SIGN_OFFSET, fuses.signature, MCU_SIGNATURE_SIZE);
+    ack_data[PL_FUSES_ACK_CAL_OFFSET] = fuses.calibration;
+    memcpy(ack_data + PL_FUSES_ACK_VALUES_OFFSET, fuses.fuses, AVR_FUSES_NUM);
+    ack_data[PL_FUSES_ACK_FAILED_OFFSET] = failed;
+
+    status = send_ack_data(status, ack_data, sizeof ack_data, out_queue);
+    SYS_ASSERT_CRITICAL(status);
+
+    return status;
+}
+
+
+/*
+ * ************************************************************
+ * Programs next piece of Intel HEX text. Stream starts with the
+ * first packet after the previous one has ended or failed.
+ * ************************************************************
+ */
+static _i16 process_program_hex_packet(OsiMsgQ_t *out_queue, Packet *packet) {
+    _i16 status = 0;
+    _u8 *buf = packet->packet_data;
+    _u16 len = packet->header.data_size;
+    AvrMemoryType memory_type;
+    _u8 ack_data[PL_HEX_ACK_SIZE] = {FALSE};
+
+    if(len < PL_HEX_TEXT_OFFSET) {
+        return -1;
+    }
+
+    memory_type = get_memory_type(buf[PL_HEX_MEMORY_OFFSET]);
+
+    if(!hex_stream.active || hex_stream.memory_type != memory_type) {
+        if(hex_stream.active) {
+            status = flush_hex_page();
+        }
+
+        if(status >= 0) {
+            status = hex_stream_begin(memory_type);
+        }
     }
 
     if(status >= 0) {
-        status = send_packet(packet, MemoryPacket, mem_data.bytes_to_read, out_queue);
+        status = ihex_feed(&hex_stream.parser, buf + PL_HEX_TEXT_OFFSET,
+                           len - PL_HEX_TEXT_OFFSET);
+    }
+
+    if(status >= 0 && ihex_eof(&hex_stream.parser)) {
+        status = flush_hex_page();
+
+        hex_stream.active = FALSE;
+        ack_data[PL_HEX_ACK_EOF_OFFSET] = (status >= 0);
+    }
+
+    if(status < 0) {
+        send_error("Failed to program HEX\r\n", out_queue);
+        hex_stream.active = FALSE;
+    }
+
+    status = send_ack_data(status, ack_data, sizeof ack_data, out_queue);
+    SYS_ASSERT_CRITICAL(status);
+
+    return status;
+}
+
+
+/* EEPROM written byte by byte is gathered into chunks of buffer size */
+static _i16 hex_stream_begin(AvrMemoryType memory_type) {
+    _u32 page_size;
+    const AvrMcuInfo *info = programmer_mcu_info();
+
+    if(info == NULL) {
+        return -1;
+    }
+
+    if(memory_type == MEMORY_FLASH) {
+        page_size = (_u32)info->flash_page_size * AVR_WORD_SIZE;
+    }
+    else if(memory_type == MEMORY_EEPROM) {
+        page_size = info->eeprom_page_size ? info->eeprom_page_size : HEX_PAGE_MAX_SIZE;
+    }
+    else {
+        return -1;
+    }
+
+    if(page_size == 0 || page_size > HEX_PAGE_MAX_SIZE) {
+        return -1;
+    }
+
+    ihex_init(&hex_stream.parser, hex_data_received, NULL);
+
+    hex_stream.memory_type = memory_type;
+    hex_stream.page_size = page_size;
+    hex_stream.next_page = 0;
+    hex_stream.lo = hex_stream.hi = 0;
+    memset(hex_stream.page, 0xFF, sizeof hex_stream.page);
+    hex_stream.active = TRUE;
+
+    return 0;
+}
+
+
+static _i16 hex_data_received(void *ctx, _u32 address, const _u8 *data, _u8 len) {
+    (void)ctx;
+    _i16 status;
+
+    for(_u8 i=0; i<len; i++, address++) {
+        _u32 page_address = address & ~((_u32)hex_stream.page_size - 1);
+        _u16 offset = address - page_address;
+
+        if(page_address != hex_stream.page_address) {
+            status = flush_hex_page();
+            OSI_ASSERT_ON_ERROR(status);
+
+            if(hex_stream.memory_type == MEMORY_FLASH && page_address < hex_stream.next_page) {
+                OSI_COMMON_LOG("HEX goes back to programmed page 0x%x\r\n", page_address);
+                return -1;
+            }
+
+            hex_stream.page_address = page_address;
+        }
+
+        hex_stream.page[offset] = data[i];
+
+        if(hex_stream.lo == hex_stream.hi) {
+            hex_stream.lo = offset;
+            hex_stream.hi = offset + 1;
+        }
+        else if(offset < hex_stream.lo) {
+            hex_stream.lo = offset;
+        }
+        else if(offset >= hex_stream.hi) {
+            hex_stream.hi = offset + 1;
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * ************************************************************
+ * Programs touched part of page. Gaps left by records are 0xFF.
+ * Flash is programmed by whole words with word address.
+ * ************************************************************
+ */
+static _i16 flush_hex_page(void) {
+    _i16 status;
+    AvrProgMemData mem_data;
+    _u16 lo = hex_stream.lo;
+    _u16 hi = hex_stream.hi;
+
+    if(lo == hi) {
+        return 0;
+    }
+
+    mem_data.memory_type = hex_stream.memory_type;
+
+    if(hex_stream.memory_type == MEMORY_FLASH) {
+        lo &= ~(AVR_WORD_SIZE - 1);
+        hi = (hi + AVR_WORD_SIZE - 1) & ~(AVR_WORD_SIZE - 1);
+        mem_data.start_address = (hex_stream.page_address + lo) / AVR_WORD_SIZE;
+
+        if(hex_stream.page_address + hex_stream.page_size > hex_stream.next_page) {
+            hex_stream.next_page = hex_stream.page_address + hex_stream.page_size;
+        }
+    }
+    else {
+        mem_data.start_address = hex_stream.page_address + lo;
+    }
+
+    mem_data.data = hex_stream.page + lo;
+    mem_data.data_len = hi - lo;
+
+    status = programmer_program_memory(&mem_data);
+
+    memset(hex_stream.page, 0xFF, hex_stream.page_size);
+    hex_stream.lo = hex_stream.hi = 0;
+
+    return status;
+}
+
+
+static inline _u32 get_u32(_u8 *buf) {
+    return (buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+}
+
+
+static inline void put_u32(_u8 *buf, _u32 value) {
+    buf[0] = (value >> 24) & 0xFF;
+    buf[1] = (value >> 16) & 0xFF;
+    buf[2] = (value >> 8) & 0xFF;
+    buf[3] = value & 0xFF;
+}
+
+
+/* Memory can not be accessed till MCU info is loaded or selected */
+static _i16 check_mcu_info(OsiMsgQ_t *out_queue) {
+    _i16 status;
+
+    if(programmer_mcu_info() != NULL) {
+        return 0;
+    }
+
+    send_error("MCU info is not loaded\r\n", out_queue);
+
+    status = send_ack(-1, out_queue);
+    SYS_ASSERT_CRITICAL(status);
+
+    return -1;
+}
+
+
+
+/***************************** STREAMING ************************************/
+/**                                                                        **/
+/****************************************************************************/
+/* Stream is dropped when its connection is closed */
+void controller_cancel_stream(OsiMsgQ_t *out_queue) {
+    if(read_stream.out_queue == out_queue) {
+        read_stream.active = FALSE;
+    }
+
+    if(program_window.out_queue == out_queue) {
+        program_window.size = 0;
+    }
+}
+
+
+/*
+ * ************************************************************
+ * Reads next chunk of active stream right into pooled packet
+ * and queues it. Handling task sends previous chunks while the
+ * next one is read from MCU.
+ * ************************************************************
+ */
+static _i16 stream_next_chunk(void) {
+    _i16 status;
+    _i32 read;
+    Packet *chunk;
+    AvrReadMemData chunk_data;
+    AvrReadMemData *mem_data = &read_stream.mem_data;
+
+    if(!read_stream.active) {
+        return 0;
+    }
+
+    /* All packets are in flight. Try again when some are sent. */
+    if(get_packet_from_pool(&chunk) < 0) {
+        osi_Sleep(1);
+        return 0;
+    }
+
+    chunk_data = *mem_data;
+    if(chunk_data.bytes_to_read > PL_MEMORY_CHUNK_SIZE) {
+        chunk_data.bytes_to_read = PL_MEMORY_CHUNK_SIZE;
+    }
+
+    read = programmer_read_memory(&chunk_data, chunk->packet_data + PL_MEMORY_DATA_OFFSET);
+    if(read < 0) {
+        release_packet(chunk);
+        read_stream.active = FALSE;
+
+        status = send_error("Failed to read memory\r\n", read_stream.out_queue);
+        OSI_ASSERT_ON_ERROR(status);
+
+        return -1;
+    }
+
+    chunk->packet_data[PL_MEMORY_SEQ_OFFSET] = (read_stream.seq >> 8) & 0xFF;
+    chunk->packet_data[PL_MEMORY_SEQ_OFFSET+1] = read_stream.seq & 0xFF;
+
+    status = stream_packet(chunk, MemoryPacket, PL_MEMORY_DATA_OFFSET + read, read_stream.out_queue,
+                           &read_stream.active);
+    if(status < 0) {
+        /* Cancelled by closed connection */
+        if(!read_stream.active) {
+            return 0;
+        }
+
+        read_stream.active = FALSE;
         OSI_ASSERT_ON_ERROR(status);
     }
 
+    /* Flash is addressed by words */
+    if(mem_data->mem_t == MEMORY_FLASH) {
+        mem_data->start_address += read / AVR_WORD_SIZE;
+    }
+    else {
+        mem_data->start_address += read;
+    }
+
+    mem_data->bytes_to_read -= read;
+    read_stream.seq++;
+
+    if(mem_data->bytes_to_read == 0) {
+        read_stream.active = FALSE;
+    }
+
     return status;
 }
@@ -6,8 +6,17 @@
 #include "osi.h"
 
 
+/* Returned by process_packet() when packet is owned by controller */
+#define CONTROLLER_PACKET_TAKEN     1
+
+
+_i16 controller_start(void);
 _i16 process_packet(OsiMsgQ_t *out_queue, Packet *packet);
 
+_u8  controller_busy(void);
+_u8  controller_ready(const PacketHeader *header);
+void controller_cancel_stream(OsiMsgQ_t *out_queue);
+
 
 
 #endif // CONTROLLER_H_INCLUDED
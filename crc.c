@@ -0,0 +1,62 @@
+#include "crc.h"
+
+
+/* Reflected polynomial */
+#define CRC32_POLY          0xEDB88320
+
+
+/*
+ * Slice-by-4 tables. The first one is the classic byte table,
+ * others advance CRC of a byte by one more zero byte each.
+ */
+static _u32 crc32_table[4][256];
+
+
+/* Tables are built once at start up */
+void crc32_init(void) {
+    for(_u32 i=0; i<256; i++) {
+        _u32 crc = i;
+
+        for(int bit=0; bit<8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32_POLY : (crc >> 1);
+        }
+
+        crc32_table[0][i] = crc;
+    }
+
+    for(_u32 i=0; i<256; i++) {
+        for(int t=1; t<4; t++) {
+            _u32 prev = crc32_table[t-1][i];
+            crc32_table[t][i] = (prev >> 8) ^ crc32_table[0][prev & 0xFF];
+        }
+    }
+}
+
+
+/*
+ * Continues CRC over the next block of data. Start with
+ * CRC32_INIT, result of each call is the CRC of everything
+ * passed so far.
+ *
+ * Four bytes are processed per step. Data need not be aligned.
+ */
+_u32 crc32_update(_u32 crc, const _u8 *data, _u32 len) {
+    crc = ~crc;
+
+    while(len >= 4) {
+        crc ^= data[0] | (data[1] << 8) | (data[2] << 16) | ((_u32)data[3] << 24);
+        crc = crc32_table[3][crc & 0xFF] ^
+              crc32_table[2][(crc >> 8) & 0xFF] ^
+              crc32_table[1][(crc >> 16) & 0xFF] ^
+              crc32_table[0][crc >> 24];
+
+        data += 4;
+        len -= 4;
+    }
+
+    while(len--) {
+        crc = crc32_table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
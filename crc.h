@@ -0,0 +1,15 @@
+#ifndef CRC_H_INCLUDED
+#define CRC_H_INCLUDED
+
+#include "simplelink.h"
+
+
+/* CRC-32 (IEEE 802.3), same as zlib crc32() */
+#define CRC32_INIT          0
+
+
+void crc32_init(void);
+_u32 crc32_update(_u32 crc, const _u8 *data, _u32 len);
+
+
+#endif // CRC_H_INCLUDED
@@ -0,0 +1,165 @@
+#include "ihex.h"
+
+#include <string.h>
+
+
+/* Record fields */
+#define IHEX_LEN_OFFSET         0
+#define IHEX_ADDRESS_OFFSET     1
+#define IHEX_TYPE_OFFSET        3
+#define IHEX_DATA_OFFSET        4
+#define IHEX_FIXED_SIZE         5
+
+/* Record types */
+#define IHEX_DATA               0x00
+#define IHEX_END_OF_FILE        0x01
+#define IHEX_EXT_SEGMENT_ADDR   0x02
+#define IHEX_START_SEGMENT_ADDR 0x03
+#define IHEX_EXT_LINEAR_ADDR    0x04
+#define IHEX_START_LINEAR_ADDR  0x05
+
+
+static _i16 hex_digit(_u8 c);
+static _i16 process_record(IhexParser *parser);
+
+
+void ihex_init(IhexParser *parser, IhexDataCallback callback, void *ctx) {
+    memset(parser, 0, sizeof *parser);
+
+    parser->callback = callback;
+    parser->ctx = ctx;
+}
+
+
+/*
+ * ********************************************************************
+ * Decodes next piece of HEX text. Line endings and other whitespace
+ * between records are skipped. Text after end of file record is
+ * ignored.
+ *
+ * Returns -1 on malformed record, wrong checksum or callback error.
+ * Parser must be initialized again after that.
+ * ********************************************************************
+ */
+_i16 ihex_feed(IhexParser *parser, const _u8 *text, _u32 len) {
+    for(_u32 i=0; i<len && !parser->eof; i++) {
+        _u8 c = text[i];
+        _i16 digit;
+
+        if(!parser->in_record) {
+            if(c == ':') {
+                parser->in_record = TRUE;
+                parser->nibble_pending = FALSE;
+                parser->record_len = 0;
+            }
+            else if(c != '\r' && c != '\n' && c != ' ' && c != '\t') {
+                return -1;
+            }
+
+            continue;
+        }
+
+        digit = hex_digit(c);
+        if(digit < 0) {
+            return -1;
+        }
+
+        if(!parser->nibble_pending) {
+            parser->high_nibble = digit;
+            parser->nibble_pending = TRUE;
+            continue;
+        }
+
+        parser->nibble_pending = FALSE;
+        parser->record[parser->record_len++] = (parser->high_nibble << 4) | digit;
+
+        /* Record is complete once byte count and all it implies are there */
+        if(parser->record_len == IHEX_FIXED_SIZE + parser->record[IHEX_LEN_OFFSET]) {
+            parser->in_record = FALSE;
+
+            if(process_record(parser) < 0) {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+_u8 ihex_eof(const IhexParser *parser) {
+    return parser->eof;
+}
+
+
+static _i16 process_record(IhexParser *parser) {
+    _u8 *rec = parser->record;
+    _u8 data_len = rec[IHEX_LEN_OFFSET];
+    _u8 *data = rec + IHEX_DATA_OFFSET;
+    _u16 offset = (rec[IHEX_ADDRESS_OFFSET] << 8) | rec[IHEX_ADDRESS_OFFSET+1];
+    _u8 sum = 0;
+
+    /* All bytes including checksum add up to zero */
+    for(_u16 i=0; i<parser->record_len; i++) {
+        sum += rec[i];
+    }
+
+    if(sum != 0) {
+        return -1;
+    }
+
+    switch(rec[IHEX_TYPE_OFFSET]) {
+
+        case IHEX_DATA:
+            if(data_len == 0) {
+                return 0;
+            }
+
+            return parser->callback(parser->ctx, parser->base_address + offset,
+                                    data, data_len);
+
+        case IHEX_END_OF_FILE:
+            parser->eof = TRUE;
+            return 0;
+
+        case IHEX_EXT_SEGMENT_ADDR:
+            if(data_len != 2) {
+                return -1;
+            }
+
+            parser->base_address = ((_u32)data[0] << 12) | ((_u32)data[1] << 4);
+            return 0;
+
+        case IHEX_EXT_LINEAR_ADDR:
+            if(data_len != 2) {
+                return -1;
+            }
+
+            parser->base_address = ((_u32)data[0] << 24) | ((_u32)data[1] << 16);
+            return 0;
+
+        /* Entry point means nothing for a programmer */
+        case IHEX_START_SEGMENT_ADDR:
+        case IHEX_START_LINEAR_ADDR:
+            return 0;
+    }
+
+    return -1;
+}
+
+
+static _i16 hex_digit(_u8 c) {
+    if(c >= '0' && c <= '9') {
+        return c - '0';
+    }
+
+    if(c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+
+    if(c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+
+    return -1;
+}
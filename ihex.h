@@ -0,0 +1,41 @@
+#ifndef IHEX_H_INCLUDED
+#define IHEX_H_INCLUDED
+
+#include "simplelink.h"
+
+
+/* Byte count, address, type, data and checksum */
+#define IHEX_MAX_DATA           255
+#define IHEX_RECORD_MAX_SIZE    (IHEX_MAX_DATA + 5)
+
+
+/* Gets data of every data record. Address is absolute byte address. */
+typedef _i16 (*IhexDataCallback)(void *ctx, _u32 address, const _u8 *data, _u8 len);
+
+
+/*
+ * Record is decoded as its text comes, so text may be split
+ * anywhere, even inside hex digit pairs.
+ */
+typedef struct {
+    _u8                 in_record;
+    _u8                 high_nibble;
+    _u8                 nibble_pending;
+    _u16                record_len;
+    _u8                 record[IHEX_RECORD_MAX_SIZE];
+
+    /* Set by extended segment and extended linear address records */
+    _u32                base_address;
+    _u8                 eof;
+
+    IhexDataCallback    callback;
+    void                *ctx;
+} IhexParser;
+
+
+void ihex_init(IhexParser *parser, IhexDataCallback callback, void *ctx);
+_i16 ihex_feed(IhexParser *parser, const _u8 *text, _u32 len);
+_u8  ihex_eof(const IhexParser *parser);
+
+
+#endif // IHEX_H_INCLUDED
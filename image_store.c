@@ -0,0 +1,217 @@
+#include "image_store.h"
+
+#include "crc.h"
+#include "config.h"
+#include "logging.h"
+
+
+
+/* Only one image is kept */
+#define IMAGE_FNAME             "avr_image.bin"
+#define IMAGE_MAGIC             0x41565249
+
+/* Buffer used to check CRC of stored image */
+#define IMAGE_CHECK_CHUNK       256
+
+
+/* Written in front of image data */
+typedef struct {
+    _u32        magic;
+    ImageInfo   info;
+} ImageHeader;
+
+#define IMAGE_DATA_OFFSET       (sizeof(ImageHeader))
+
+
+/* Image being uploaded */
+static _u8          uploading = FALSE;
+static long         upload_hndl;
+static ImageInfo    upload_info;
+static _u32         upload_written;
+static _u32         upload_crc;
+
+/* Image being programmed */
+static _u8          reading = FALSE;
+static long         read_hndl;
+
+
+/*
+ * ************************************************************
+ * Creates file for a new image. Previous image is removed as
+ * file size is fixed on creation.
+ *
+ * File is not created fail-safe, which would take twice as much
+ * serial flash. Broken image is detected by CRC instead.
+ * ************************************************************
+ */
+_i16 image_store_begin(const ImageInfo *info) {
+    _i32 status;
+    ImageHeader header;
+
+    if(info->length == 0 || info->length > IMAGE_STORE_MAX_SIZE ||
+       info->memory_type == MEMORY_ERR)
+    {
+        return -1;
+    }
+
+    image_store_abort();
+    image_store_close();
+
+    sl_FsDel(IMAGE_FNAME, 0);
+
+    status = sl_FsOpen(IMAGE_FNAME,
+                       FS_MODE_OPEN_CREATE(IMAGE_DATA_OFFSET + info->length,
+                                           _FS_FILE_OPEN_FLAG_NO_SIGNATURE_TEST |
+                                           _FS_FILE_PUBLIC_READ |
+                                           _FS_FILE_PUBLIC_WRITE),
+                       NULL, &upload_hndl);
+    OSI_ASSERT_ON_ERROR(status);
+
+    header.magic = IMAGE_MAGIC;
+    header.info = *info;
+
+    status = sl_FsWrite(upload_hndl, 0, (_u8*)&header, sizeof header);
+    if(status != sizeof header) {
+        sl_FsClose(upload_hndl, NULL, NULL, 0);
+        sl_FsDel(IMAGE_FNAME, 0);
+
+        return -1;
+    }
+
+    upload_info = *info;
+    upload_written = 0;
+    upload_crc = CRC32_INIT;
+    uploading = TRUE;
+
+    return 0;
+}
+
+
+/*
+ * ************************************************************
+ * Appends chunk of image. Chunks must come in order. File is
+ * closed after the last one and removed if CRC of received
+ * data does not match.
+ * ************************************************************
+ */
+_i16 image_store_write(_u32 offset, const _u8 *data, _u16 len) {
+    _i32 status;
+
+    if(!uploading || offset != upload_written ||
+       len > upload_info.length - upload_written)
+    {
+        return -1;
+    }
+
+    status = sl_FsWrite(upload_hndl, IMAGE_DATA_OFFSET + offset, (_u8*)data, len);
+    if(status != len) {
+        image_store_abort();
+        return -1;
+    }
+
+    upload_crc = crc32_update(upload_crc, data, len);
+    upload_written += len;
+
+    if(upload_written < upload_info.length) {
+        return 0;
+    }
+
+    sl_FsClose(upload_hndl, NULL, NULL, 0);
+    uploading = FALSE;
+
+    if(upload_crc != upload_info.crc) {
+        OSI_COMMON_LOG("Image CRC mismatch: 0x%08x\r\n", upload_crc);
+        sl_FsDel(IMAGE_FNAME, 0);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Drops unfinished upload */
+void image_store_abort(void) {
+    if(!uploading) {
+        return;
+    }
+
+    sl_FsClose(upload_hndl, NULL, NULL, 0);
+    sl_FsDel(IMAGE_FNAME, 0);
+
+    uploading = FALSE;
+}
+
+
+/*
+ * ************************************************************
+ * Opens stored image for programming. Whole image is checked
+ * against its CRC first so that a broken one is never written.
+ * ************************************************************
+ */
+_i16 image_store_open(ImageInfo *info) {
+    _i32 status;
+    ImageHeader header;
+    _u8 buf[IMAGE_CHECK_CHUNK];
+    _u32 crc = CRC32_INIT;
+
+    if(uploading) {
+        return -1;
+    }
+
+    image_store_close();
+
+    status = sl_FsOpen(IMAGE_FNAME, FS_MODE_OPEN_READ, NULL, &read_hndl);
+    OSI_ASSERT_ON_ERROR(status);
+
+    reading = TRUE;
+
+    status = sl_FsRead(read_hndl, 0, (_u8*)&header, sizeof header);
+    if(status != sizeof header || header.magic != IMAGE_MAGIC) {
+        goto fail;
+    }
+
+    for(_u32 offset=0; offset<header.info.length; offset+=IMAGE_CHECK_CHUNK) {
+        _u16 len = IMAGE_CHECK_CHUNK;
+
+        if(header.info.length - offset < len) {
+            len = header.info.length - offset;
+        }
+
+        if(image_store_read(offset, buf, len) != len) {
+            goto fail;
+        }
+
+        crc = crc32_update(crc, buf, len);
+    }
+
+    if(crc != header.info.crc) {
+        goto fail;
+    }
+
+    *info = header.info;
+    return 0;
+
+    fail:
+        image_store_close();
+        return -1;
+}
+
+
+_i32 image_store_read(_u32 offset, _u8 *buf, _u16 len) {
+    if(!reading) {
+        return -1;
+    }
+
+    return sl_FsRead(read_hndl, IMAGE_DATA_OFFSET + offset, buf, len);
+}
+
+
+void image_store_close(void) {
+    if(!reading) {
+        return;
+    }
+
+    sl_FsClose(read_hndl, NULL, NULL, 0);
+    reading = FALSE;
+}
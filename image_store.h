@@ -0,0 +1,27 @@
+#ifndef IMAGE_STORE_H_INCLUDED
+#define IMAGE_STORE_H_INCLUDED
+
+#include "simplelink.h"
+
+#include "programmer_parser.h"
+
+
+/* Describes image staged in serial flash */
+typedef struct {
+    AvrMemoryType   memory_type;
+    _u32            start_address;
+    _u32            length;
+    _u32            crc;
+} ImageInfo;
+
+
+_i16 image_store_begin(const ImageInfo *info);
+_i16 image_store_write(_u32 offset, const _u8 *data, _u16 len);
+void image_store_abort(void);
+
+_i16 image_store_open(ImageInfo *info);
+_i32 image_store_read(_u32 offset, _u8 *buf, _u16 len);
+void image_store_close(void);
+
+
+#endif // IMAGE_STORE_H_INCLUDED
@@ -0,0 +1,100 @@
+#include "lz4.h"
+
+#include <string.h>
+
+
+/* Sequence token: literal length in high nibble, match length in low one */
+#define LZ4_RUN_MASK            0x0F
+#define LZ4_LITERALS_SHIFT      4
+#define LZ4_MIN_MATCH           4
+#define LZ4_OFFSET_SIZE         2
+
+
+static _i16 read_length(const _u8 **src, const _u8 *src_end, _u32 *length);
+
+
+/*
+ * ********************************************************************
+ * Decodes one LZ4 block (format of LZ4_compress_default(), no frame).
+ * Block is self-contained, so the only memory used is output buffer,
+ * which is the window for matches.
+ *
+ * Every length and offset is checked, so malformed input can not
+ * read or write outside of buffers.
+ *
+ * Returns number of decompressed bytes or -1.
+ * ********************************************************************
+ */
+_i32 lz4_decompress_block(const _u8 *src, _u32 src_len, _u8 *dst, _u32 dst_size) {
+    const _u8 *src_end = src + src_len;
+    _u32 out = 0;
+
+    while(src < src_end) {
+        _u8 token = *src++;
+        _u32 literals = token >> LZ4_LITERALS_SHIFT;
+        _u32 match;
+        _u32 offset;
+
+        if(literals == LZ4_RUN_MASK && read_length(&src, src_end, &literals) < 0) {
+            return -1;
+        }
+
+        if(literals > (_u32)(src_end - src) || literals > dst_size - out) {
+            return -1;
+        }
+
+        memcpy(dst + out, src, literals);
+        src += literals;
+        out += literals;
+
+        /* The last sequence has literals only */
+        if(src == src_end) {
+            break;
+        }
+
+        if(src_end - src < LZ4_OFFSET_SIZE) {
+            return -1;
+        }
+
+        offset = src[0] | (src[1] << 8);
+        src += LZ4_OFFSET_SIZE;
+
+        if(offset == 0 || offset > out) {
+            return -1;
+        }
+
+        match = token & LZ4_RUN_MASK;
+        if(match == LZ4_RUN_MASK && read_length(&src, src_end, &match) < 0) {
+            return -1;
+        }
+
+        match += LZ4_MIN_MATCH;
+        if(match > dst_size - out) {
+            return -1;
+        }
+
+        /* Match may overlap its own output, e.g. runs of 0xFF */
+        for(_u32 i=0; i<match; i++, out++) {
+            dst[out] = dst[out - offset];
+        }
+    }
+
+    return out;
+}
+
+
+/* Extra length bytes follow till one is less than 255 */
+static _i16 read_length(const _u8 **src, const _u8 *src_end, _u32 *length) {
+    _u8 byte;
+
+    do {
+        if(*src >= src_end) {
+            return -1;
+        }
+
+        byte = *(*src)++;
+        *length += byte;
+    } while(byte == 0xFF);
+
+    return 0;
+}
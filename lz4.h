@@ -0,0 +1,10 @@
+#ifndef LZ4_H_INCLUDED
+#define LZ4_H_INCLUDED
+
+#include "simplelink.h"
+
+
+_i32 lz4_decompress_block(const _u8 *src, _u32 src_len, _u8 *dst, _u32 dst_size);
+
+
+#endif // LZ4_H_INCLUDED
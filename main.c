@@ -103,6 +103,7 @@
 #include "packets.h"
 
 #include "programmer.h"
+#include "controller.h"
 #include "bridge.h"
 
 #include "config.h"
@@ -242,7 +243,7 @@ static void vInitializationTask(void *pvParameters) {
     int wlan_connecting_time;
 
     /*** MCU RESET ***/
-    sys_reset_mcu(MCU_RESET_OFF);
+    sys_release_targets();
 
     /* Initializing WLAN module first in order to enable simplelink */
     status = wlan_init();
@@ -288,6 +289,10 @@ static void vInitializationTask(void *pvParameters) {
     status = udp_resolver_start(&cfg);
     OSI_ASSERT_WITH_EXIT(status, init_handle);
 
+    /*** STARTING PROGRAMMER ***/
+    status = controller_start();
+    OSI_ASSERT_WITH_EXIT(status, init_handle);
+
     /*** STARTING LISTENING AND PACKET HANDLING  ***/
     packet_handler_start();
 
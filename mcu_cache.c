@@ -0,0 +1,117 @@
+#include "mcu_cache.h"
+
+#include "crc.h"
+#include "logging.h"
+
+#include <string.h>
+
+
+/*
+ * Compiled MCU info is kept in serial flash, one file per target
+ * signature. Version must be bumped whenever AvrMcuInfo layout
+ * changes so that stale entries are not used.
+ */
+#define MCU_CACHE_MAGIC         0x4D435543
+#define MCU_CACHE_VERSION       3
+
+/* "mcu_XXXXXX.bin" */
+#define MCU_CACHE_PREFIX        "mcu_"
+#define MCU_CACHE_SUFFIX        ".bin"
+#define MCU_CACHE_FNAME_SIZE    (sizeof MCU_CACHE_PREFIX - 1 + 2*MCU_SIGNATURE_SIZE + sizeof MCU_CACHE_SUFFIX)
+
+
+typedef struct {
+    _u32        magic;
+    _u16        version;
+    _u16        info_size;
+    _u32        crc;
+    AvrMcuInfo  info;
+} McuCacheEntry;
+
+
+/* Too big for programmer task stack. Only that task uses cache. */
+static McuCacheEntry entry;
+
+static void get_file_name(const _u8 *signature, char *fname);
+
+
+_i16 mcu_cache_load(const _u8 *signature, AvrMcuInfo *info) {
+    _i32 status;
+    long file_hndl;
+    char fname[MCU_CACHE_FNAME_SIZE];
+
+    get_file_name(signature, fname);
+
+    status = sl_FsOpen(fname, FS_MODE_OPEN_READ, NULL, &file_hndl);
+    if(status < 0) {
+        return -1;
+    }
+
+    status = sl_FsRead(file_hndl, 0, (_u8*)&entry, sizeof entry);
+    sl_FsClose(file_hndl, NULL, NULL, 0);
+
+    if(status != sizeof entry ||
+       entry.magic != MCU_CACHE_MAGIC ||
+       entry.version != MCU_CACHE_VERSION ||
+       entry.info_size != sizeof entry.info ||
+       entry.crc != crc32_update(CRC32_INIT, (_u8*)&entry.info, sizeof entry.info))
+    {
+        return -1;
+    }
+
+    *info = entry.info;
+    return 0;
+}
+
+
+/* Entry of the same signature is replaced */
+_i16 mcu_cache_store(const _u8 *signature, const AvrMcuInfo *info) {
+    _i32 status;
+    long file_hndl;
+    char fname[MCU_CACHE_FNAME_SIZE];
+
+    get_file_name(signature, fname);
+
+    entry.magic = MCU_CACHE_MAGIC;
+    entry.version = MCU_CACHE_VERSION;
+    entry.info_size = sizeof entry.info;
+    entry.info = *info;
+    entry.crc = crc32_update(CRC32_INIT, (_u8*)&entry.info, sizeof entry.info);
+
+    sl_FsDel(fname, 0);
+
+    status = sl_FsOpen(fname,
+                       FS_MODE_OPEN_CREATE(sizeof entry,
+                                           _FS_FILE_OPEN_FLAG_COMMIT |
+                                           _FS_FILE_OPEN_FLAG_NO_SIGNATURE_TEST |
+                                           _FS_FILE_PUBLIC_READ |
+                                           _FS_FILE_PUBLIC_WRITE),
+                       NULL, &file_hndl);
+    OSI_ASSERT_ON_ERROR(status);
+
+    status = sl_FsWrite(file_hndl, 0, (_u8*)&entry, sizeof entry);
+    sl_FsClose(file_hndl, NULL, NULL, 0);
+
+    if(status != sizeof entry) {
+        sl_FsDel(fname, 0);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void get_file_name(const _u8 *signature, char *fname) {
+    static const char hex[] = "0123456789abcdef";
+    char *p = fname;
+
+    memcpy(p, MCU_CACHE_PREFIX, sizeof MCU_CACHE_PREFIX - 1);
+    p += sizeof MCU_CACHE_PREFIX - 1;
+
+    for(_u8 i=0; i<MCU_SIGNATURE_SIZE; i++) {
+        *p++ = hex[signature[i] >> 4];
+        *p++ = hex[signature[i] & 0x0F];
+    }
+
+    memcpy(p, MCU_CACHE_SUFFIX, sizeof MCU_CACHE_SUFFIX);
+}
@@ -0,0 +1,13 @@
+#ifndef MCU_CACHE_H_INCLUDED
+#define MCU_CACHE_H_INCLUDED
+
+#include "simplelink.h"
+
+#include "programmer_parser.h"
+
+
+_i16 mcu_cache_load(const _u8 *signature, AvrMcuInfo *info);
+_i16 mcu_cache_store(const _u8 *signature, const AvrMcuInfo *info);
+
+
+#endif // MCU_CACHE_H_INCLUDED
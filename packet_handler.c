@@ -1,4 +1,5 @@
 #include <stddef.h>
+#include <string.h>
 #include "osi.h"
 #include "socket.h"
 
@@ -12,20 +13,23 @@
 #include "config.h"
 #include "controller.h"
 
-/* 10 ms timeout */
+/*
+ * Queued packets and new connections wake select() right away.
+ * Timeout only bounds the wait if a wake datagram is lost.
+ */
 #define     SELECT_TIMEOUT_US       10000
-#define     QUEUE_READ_TIMEOUT_MS   1
 
 #define     HNDL_INACTIVE           -1
 
+/* Wake datagram carries nothing, only its arrival matters */
+#define     WAKE_DATAGRAM_SIZE      1
+
 /* Tasks prototypes */
-static void vListeningTask(void *pvParameters);
 static void vHandlingTask(void *pvParameters);
 
 
 /* Task handles */
 static OsiTaskHandle    handling_task_hndl;
-static OsiTaskHandle    listen_task_hndl;
 
 /* Contains current connections */
 static ConnectionInfo   *conn_info[PACKETS_GROUPS_NUM] = {NULL, NULL, NULL};
@@ -37,21 +41,48 @@ static pool_t           connections_pool;
     Used in pool. */
 static void             conn_constructor(void *conn_info);
 
-/* Connections are passed through this queue from listening task to reading task */
-static OsiMsgQ_t        connections_queue;
+/* Listening socket is watched by select() together with connections */
+static _i16             listen_sock = HNDL_INACTIVE;
+
+/*
+ * Loopback UDP socket. Tasks queueing packets send a datagram to it,
+ * so select() returns without waiting for timeout.
+ */
+static _i16             wake_sock = HNDL_INACTIVE;
+static sockaddr_in      wake_addr;
+
+/* Datagram is on its way and handling task has not drained it yet */
+static volatile _u8     wake_pending = FALSE;
+
+/*
+ * No packet was left in pool to start a frame. Connections waiting
+ * for one are not watched till packets are sent or released.
+ */
+static _u8              pool_starved = FALSE;
+
+/* Frames queued for one connection are copied here and sent at once */
+static _u8              tx_buf[TCP_TX_COALESCE_SIZE];
 
 
 /* Function which helps to receive and send packets */
-static          _i16 recv_packet(_i16 sock, Packet *packet);
+static          _i16 receive_frame(ConnectionInfo *info);
+static          void dispatch_packet(ConnectionInfo *info);
 static          _i16 send_packet(_i16 sock, Packet *packet);
-static          _i16 recv_nbytes(_i16 sock, _u8 *buf, _u16 n);
 static          _i16 send_nbytes(_i16 sock, _u8 *buf, _u16 n);
+static          void send_queued(ConnectionInfo *info);
+static          void send_batch(ConnectionInfo *info, Packet **batch, _u8 num, _u16 len);
 
 
 /* Miscellaneous functions */
+static          _i16 open_listen_socket(void);
+static          _i16 open_wake_socket(void);
+static          void accept_connection(void);
+static          void drain_wake_socket(void);
+static          void drain_queue(OsiMsgQ_t *queue);
+static          _i16 set_non_blocking(_i16 sock);
 static inline   _i16 get_read_fd(ConnectionInfo **conn_info, fd_set *set);
 static inline   _i16 check_connection(ConnectionInfo *info);
-static inline   _i16 close_conn(ConnectionInfo *info, Packet *packet);
+static inline   _i16 close_conn(ConnectionInfo *info);
 static inline   _i16 disable_connection(ConnectionInfo *info);
 
 
@@ -61,25 +92,15 @@ _i8 packet_handler_start(void) {
     /* Create pool for connections */
     pool_create(&connections_pool, conn_constructor, sizeof(ConnectionInfo), MAX_TCP_CONNECTIONS);
 
-    /* Initialize queue for passing connections through */
-    status = osi_MsgQCreate(&connections_queue, "ConnectionsQueue",
-                            sizeof(ConnectionInfo*), MAX_TCP_CONNECTIONS);
-    OSI_ASSERT_ON_ERROR(status);
-
     /* Create packets pool */
     status = initialize_packets_pool(MSG_POOL_SIZE);
     OSI_ASSERT_ON_ERROR(status);
 
-    /* Start packet handler task */
+    /* Start packet handler task. It listens for connections too. */
     status = osi_TaskCreate(vHandlingTask, HANDLING_TASK_NAME, HANDLING_TASK_STACK_SIZE,
                             NULL, HANDLING_TASK_PRIORITY, &handling_task_hndl);
     OSI_ASSERT_ON_ERROR(status);
 
-    /* Start listening for connections */
-    status = osi_TaskCreate(vListeningTask, LISTENING_TASK_NAME, LISTENING_TASK_STACK_SIZE,
-                            NULL, LISTENING_TASK_PRIORITY, &listen_task_hndl);
-    OSI_ASSERT_ON_ERROR(status);
-
     return status;
 }
 
@@ -93,203 +114,290 @@ _i8 packet_handler_stop(void) {
 }
 
 
+/*
+ * ************************************************************
+ * Wakes handling task when packet has been queued for sending.
+ * Called from any task after the queue write. One datagram is
+ * enough for any number of packets queued before it is read.
+ * ************************************************************
+ */
+void packet_handler_wake(void) {
+    _u8 wake = 0;
 
-/* **************************************************
- *                Listening task                    *
- ****************************************************
- *                                                  *
- *   Configures WLAN module and load all necessary  *
- *      middleware drivers                          *
- *                                                  *
- * ************************************************ */
- static void vListeningTask(void *pvParameters) {
-     OSI_COMMON_LOG("Inside listening task\r\n");
-    _i8 status;
-    _i16 listen_sock;
-    sockaddr_in local_addr;
-    sockaddr_in remote_addr;
-    socklen_t   remote_addr_l;
-
-    local_addr.sin_family = AF_INET;
-    local_addr.sin_port = htons(TCP_LISTENING_PORT);
-    local_addr.sin_addr.s_addr = INADDR_ANY;
-    listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    OSI_COMMON_LOG("Created socket\r\n");
-
-    status = bind(listen_sock, (sockaddr*)&local_addr, sizeof local_addr);
-    OSI_ASSERT_WITH_EXIT(status, handling_task_hndl);
-    OSI_COMMON_LOG("Binded\r\n");
-
-    status = listen(listen_sock, MAX_TCP_CONNECTIONS);
-    OSI_ASSERT_WITH_EXIT(status, handling_task_hndl);
-    OSI_COMMON_LOG("Started listening\r\n");
-
-    for( ;; ) {
-        _i16 conn = accept(listen_sock, (sockaddr*)&remote_addr, &remote_addr_l);
-        OSI_COMMON_LOG("Accepted socket %d\r\n", conn);
-
-        SlSockNonblocking_t non_blocking_en;
-        status = setsockopt(conn, SOL_SOCKET, SO_NONBLOCKING, (_u8*)&non_blocking_en, sizeof(non_blocking_en));
-        OSI_ASSERT_WITHOUT_EXIT(status);
-
-        OSI_COMMON_LOG("Changed socket to non-blocking mode\r\n");
-
-        if(conn > 0) {
-            ConnectionInfo *conn_info;
-
-            status = pool_get(&connections_pool, (void**)&conn_info);
-            OSI_ASSERT_WITHOUT_EXIT(status);
-
-            conn_info->hndl = conn;
-            conn_info->group = ControlGroup;
+    if(wake_sock == HNDL_INACTIVE || wake_pending) {
+        return;
+    }
 
-            status = sys_queue_write_ptr(&connections_queue, conn_info, 0);
-            OSI_ASSERT_WITHOUT_EXIT(status);
+    wake_pending = TRUE;
 
-        }
-        else {
-            OSI_COMMON_LOG("Maximum connections reached\r\n");
-            /* Maximum connections are used. Wait till resources will be freed. */
-            OSI_ASSERT_WITHOUT_EXIT(conn);
-            osi_Sleep(5000);
-        }
+    if(sendto(wake_sock, &wake, WAKE_DATAGRAM_SIZE, 0,
+              (sockaddr*)&wake_addr, sizeof wake_addr) < 0)
+    {
+        wake_pending = FALSE;
     }
- }
+}
+
 
 
 /* ******************************************************************
- *                              Reading task                        *
+ *                              Handling task                       *
  ********************************************************************
  *                                                                  *
- *   This task reads socket in non-blocking mode                    *
+ *   This task accepts connections and reads sockets in             *
+ *      non-blocking mode. It sleeps in select() till a socket      *
+ *      is readable or another task queues a packet to send.        *
  *                                                                  *
  *   Since exceptions in select are not supported CLIENT MUST SENT  *
  *      close connection request                                    *
  *                                                                  *
  *                                                                  *
- * ******************************************************************/
-static void vHandlingTask(void *pvParameters)
+ * ******************************************************************/
+static void vHandlingTask(void *pvParameters)
 {
     ConnectionInfo  *info;
-    _u8             conn_ptr = 0;
     _i16            status;
-    Packet          *packet;
 
     /* Select variables */
     _i16            max_fd;
+    _i16            ready;
     fd_set          read_fd;
     timeval         select_time;
 
-    select_time.tv_sec = 0;
-    select_time.tv_usec = SELECT_TIMEOUT_US;
-
-    /* Wait for the first connection */
-    OSI_COMMON_LOG("Waiting for the first connection\r\n");
-    status = sys_queue_read_ptr(&connections_queue, (void**)&info, OSI_WAIT_FOREVER);
-    ASSERT_WITHOUT_EXIT(status);
-    OSI_COMMON_LOG("Got first connection\r\n");
+    status = open_listen_socket();
+    OSI_ASSERT_WITH_EXIT(status, handling_task_hndl);
+    OSI_COMMON_LOG("Started listening\r\n");
 
-    conn_info[info->group] = info;
+    /* Without wake socket packets are still sent on select() timeout */
+    status = open_wake_socket();
+    OSI_ASSERT_WITHOUT_EXIT(status);
 
     for( ;; ) {
         max_fd = get_read_fd(conn_info, &read_fd);
 
-        /* MIN 10 MS WAITING */
-        status = select(max_fd+1, &read_fd, NULL, NULL, &select_time);
-        OSI_ASSERT_WITHOUT_EXIT(status);
-
-        if(status > 0) {
-            OSI_COMMON_LOG("There is data to read in %d sockets\r\n", status);
+        select_time.tv_sec = 0;
+        select_time.tv_usec = SELECT_TIMEOUT_US;
 
-            for(int i=0; i<PACKETS_GROUPS_NUM; i++) {
-                info = conn_info[i];
+        ready = select(max_fd+1, &read_fd, NULL, NULL, &select_time);
+        OSI_ASSERT_WITHOUT_EXIT(ready);
 
-                if(check_connection(info) == SUCCESS) {
-                    _i16 hndl = info->hndl;
+        if(ready == 0) {
+            pool_starved = FALSE;
+        }
 
-                    /* Read on this socket is available */
-                    if(FD_ISSET(hndl, &read_fd)) {
-                        OSI_COMMON_LOG("FD set on %d socket\r\n", hndl);
+        /*
+         * Cleared before queues are checked, so no wake is missed.
+         * Also cleared when datagram has not come, as a lost one
+         * would block every later wake.
+         */
+        if(ready > 0 && wake_sock != HNDL_INACTIVE && FD_ISSET(wake_sock, &read_fd)) {
+            drain_wake_socket();
+        }
+        else {
+            wake_pending = FALSE;
+        }
 
-                        status = get_packet_from_pool(&packet);
-                        OSI_ASSERT_WITHOUT_EXIT(status);
+        if(ready > 0 && FD_ISSET(listen_sock, &read_fd)) {
+            accept_connection();
+        }
 
-                        status = recv_packet(hndl, packet);
-                        OSI_ASSERT_WITHOUT_EXIT(status);
+        /*
+         * Every connection reassembles its own frame from whatever has
+         * arrived, so a stalled client never blocks the others.
+         */
+        for(int i=0; i<PACKETS_GROUPS_NUM; i++) {
+            info = conn_info[i];
 
-                        if(packet->header.type == CloseConnectionPacket) {
-                            OSI_COMMON_LOG("Closing connection\r\n");
-                            close_conn(info, packet);
-                        }
-                        else {
-                            process_packet(info->out_queue, packet);
-                        }
+            if(check_connection(info) != SUCCESS) {
+                continue;
+            }
 
-                        status = release_packet(packet);
-                        OSI_ASSERT_WITHOUT_EXIT(status);
+            if(ready > 0 && FD_ISSET(info->hndl, &read_fd)) {
+                status = receive_frame(info);
 
-                        FD_CLR(hndl, &read_fd);
-                    }
+                if(status < 0) {
+                    OSI_COMMON_LOG("Dropping connection %d\r\n", info->hndl);
+                    close_conn(info);
+                    continue;
+                }
+            }
 
-                    /* Check whether there are packets to send */
-                    while(status >= 0) {
-                        status = get_packet_from_pool(&packet);
-                        OSI_ASSERT_WITHOUT_EXIT(status);
+            if(info->rx_state == RX_COMPLETE) {
+                dispatch_packet(info);
+            }
+        }
 
-                        status = sys_queue_read_ptr(&info->out_queue, (void**)&packet, QUEUE_READ_TIMEOUT_MS);
+        /* Check whether there are packets to send */
+        for(int i=0; i<PACKETS_GROUPS_NUM; i++) {
+            info = conn_info[i];
 
-                        if(status >= 0) {
-                            OSI_COMMON_LOG("Sending packet to %d\r\n", hndl);
-                            //update_header(packet);
-                            send_packet(hndl, packet);
-                            release_packet(packet);
-                        }
-                    }
-                }
+            if(check_connection(info) == SUCCESS) {
+                send_queued(info);
             }
         }
+    }
+}
 
-        /* Check for new connections
-        MIN 1 MS WAITING
-        TODO: rewrite USING lock objects */
-        status = sys_queue_read_ptr(&connections_queue, (void**)&info, QUEUE_READ_TIMEOUT_MS);
-        if(status >= 0) {
-            //OSI_COMMON_LOG("New connection found in queue\r\n");
 
-            if(conn_info[ControlGroup] != NULL) {
-                OSI_COMMON_LOG("ERROR: two control connections at a time\r\n");
-                disable_connection(info);
-            }
-            else {
-                info->group = ControlGroup;
-                conn_info[ControlGroup] = info;
-            }
+static _i16 open_listen_socket(void) {
+    _i16 status;
+    sockaddr_in local_addr;
+
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_port = htons(TCP_LISTENING_PORT);
+    local_addr.sin_addr.s_addr = INADDR_ANY;
+
+    listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    OSI_ASSERT_ON_ERROR(listen_sock);
+
+    status = bind(listen_sock, (sockaddr*)&local_addr, sizeof local_addr);
+    OSI_ASSERT_ON_ERROR(status);
+
+    status = listen(listen_sock, MAX_TCP_CONNECTIONS);
+    OSI_ASSERT_ON_ERROR(status);
+
+    /* accept() is only called when select() reports connection */
+    return set_non_blocking(listen_sock);
+}
+
+
+static _i16 open_wake_socket(void) {
+    _i16 sock;
+    _i16 status;
+
+    wake_addr.sin_family = AF_INET;
+    wake_addr.sin_port = htons(HANDLER_WAKE_PORT);
+    wake_addr.sin_addr.s_addr = htonl(SL_IPV4_VAL(127, 0, 0, 1));
+
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    OSI_ASSERT_ON_ERROR(sock);
+
+    status = bind(sock, (sockaddr*)&wake_addr, sizeof wake_addr);
+    if(status >= 0) {
+        status = set_non_blocking(sock);
+    }
+
+    if(status < 0) {
+        close(sock);
+        OSI_ASSERT_ON_ERROR(status);
+    }
+
+    wake_sock = sock;
+    return SUCCESS;
+}
+
+
+/* New connection takes control slot if it is free */
+static void accept_connection(void) {
+    _i16 status;
+    _i16 conn;
+    sockaddr_in remote_addr;
+    socklen_t remote_addr_l = sizeof remote_addr;
+    ConnectionInfo *info;
+
+    conn = accept(listen_sock, (sockaddr*)&remote_addr, &remote_addr_l);
+    if(conn < 0) {
+        /* Maximum connections are used or connection is gone already */
+        if(conn != EAGAIN) {
+            OSI_ERROR_LOG(conn);
         }
-    }
+
+        return;
+    }
+
+    OSI_COMMON_LOG("Accepted socket %d\r\n", conn);
+
+    status = set_non_blocking(conn);
+    OSI_ASSERT_WITHOUT_EXIT(status);
+
+    if(conn_info[ControlGroup] != NULL) {
+        OSI_COMMON_LOG("ERROR: two control connections at a time\r\n");
+        close(conn);
+        return;
+    }
+
+    status = pool_get(&connections_pool, (void**)&info);
+    if(status < 0) {
+        OSI_ERROR_LOG(status);
+        close(conn);
+        return;
+    }
+
+    info->hndl = conn;
+    info->group = ControlGroup;
+    info->rx_state = RX_HEADER;
+    info->rx_packet = NULL;
+    info->rx_received = 0;
+    info->tx_frames = 0;
+    info->tx_sends = 0;
+    conn_info[ControlGroup] = info;
+}
+
+
+static void drain_wake_socket(void) {
+    _u8 buf[WAKE_DATAGRAM_SIZE];
+
+    wake_pending = FALSE;
+
+    /* Woken by programmer task releasing packet or by packet queued */
+    pool_starved = FALSE;
+
+    while(recv(wake_sock, buf, sizeof buf, 0) > 0) {
+    }
 }
 
 
+static _i16 set_non_blocking(_i16 sock) {
+    SlSockNonblocking_t non_blocking_en = {.NonblockingEnabled = 1};
 
-/* Closing connection */
-static _i16 close_conn(ConnectionInfo *info, Packet *packet) {
-    (void)packet;
+    return setsockopt(sock, SOL_SOCKET, SO_NONBLOCKING, (_u8*)&non_blocking_en,
+                      sizeof(non_blocking_en));
+}
+
+
+
+/* Closing connection. Frame being received is dropped. */
+static _i16 close_conn(ConnectionInfo *info) {
     _i16 status;
+    _u32 per_send;
+
+    /* Frames per send in hundredths, 0 when nothing was sent */
+    per_send = info->tx_sends ? (info->tx_frames * 100) / info->tx_sends : 0;
+
+    OSI_COMMON_LOG("Sent %u frames in %u sends, %u.%02u frames per send\r\n",
+                   info->tx_frames, info->tx_sends, per_send / 100, per_send % 100);
 
     conn_info[info->group] = NULL;
+    controller_cancel_stream(&info->out_queue);
+
+    if(info->rx_packet != NULL) {
+        release_packet(info->rx_packet);
+        info->rx_packet = NULL;
+    }
+
+    /* Queues are reused by next connection taking this info */
+    drain_queue(&info->in_queue);
+    drain_queue(&info->out_queue);
 
     status = disable_connection(info);
     ASSERT_ON_ERROR(status);
 
-    if(packet != NULL) {
-        status = pool_release(&connections_pool, info);
-        ASSERT_ON_ERROR(status);
-    }
+    status = pool_release(&connections_pool, info);
+    ASSERT_ON_ERROR(status);
 
     return status;
 }
 
 
 
+static void drain_queue(OsiMsgQ_t *queue) {
+    Packet *packet;
+
+    while(sys_queue_read_ptr(queue, (void**)&packet, 0) >= 0) {
+        release_packet(packet);
+    }
+}
+
+
 /*******************************************************
                 Pool constructor for connections
 ********************************************************/
@@ -305,6 +413,11 @@ static void conn_constructor(void *conn_info) {
     OSI_ASSERT_WITHOUT_EXIT(status);
 
     info->hndl = HNDL_INACTIVE;
+    info->rx_state = RX_HEADER;
+    info->rx_packet = NULL;
+    info->rx_received = 0;
+    info->tx_frames = 0;
+    info->tx_sends = 0;
 }
 
 
@@ -341,12 +454,31 @@ static _i16 disable_connection(ConnectionInfo *info) {
  * Return maximum socket handle.
  * *************************************************** */
 static inline _i16 get_read_fd(ConnectionInfo **conn_info, fd_set *set) {
-    _i16 max_fd = 0;
+    _i16 max_fd = listen_sock;
     FD_ZERO(set);
 
+    FD_SET(listen_sock, set);
+
+    if(wake_sock != HNDL_INACTIVE) {
+        FD_SET(wake_sock, set);
+
+        if(wake_sock > max_fd) {
+            max_fd = wake_sock;
+        }
+    }
+
     for(int i=0; i<PACKETS_GROUPS_NUM; i++) {
         ConnectionInfo *info = conn_info[i];
 
+        /* Received packet waits for controller. Leave data in socket. */
+        if(info != NULL && info->rx_state == RX_COMPLETE) {
+            continue;
+        }
+
+        if(info != NULL && info->rx_packet == NULL && pool_starved) {
+            continue;
+        }
+
         if(check_connection(info) == SUCCESS) {
             _i16 hndl = info->hndl;
             FD_SET(hndl, set);
@@ -361,78 +493,197 @@ static inline _i16 get_read_fd(ConnectionInfo **conn_info, fd_set *set) {
 }
 
 
-static _i16 send_packet(_i16 sock, Packet *packet) {
-    _i16 status;
-    _u16 data_size = packet->header.data_size;
+/*
+ * ************************************************************
+ * Sends all packets queued for connection without waiting.
+ * Frames are coalesced up to TCP MSS, so e.g. error followed
+ * by ACK or a run of memory chunks costs one send() and one
+ * segment over the air.
+ * ************************************************************
+ */
+static void send_queued(ConnectionInfo *info) {
+    Packet *packet;
+    Packet *batch[MSG_POOL_SIZE];
+    _u8 num = 0;
+    _u16 len = 0;
+
+    while(sys_queue_read_ptr(&info->out_queue, (void**)&packet, 0) >= 0) {
+        _u16 frame_len = PACKET_HEADER_SIZE + packet->header.data_size;
+
+        if(num == MSG_POOL_SIZE || len + frame_len > TCP_TX_COALESCE_SIZE) {
+            send_batch(info, batch, num, len);
+
+            num = 0;
+            len = 0;
+        }
 
-    status = send_nbytes(sock, packet->raw_header, PACKET_HEADER_SIZE);
-    OSI_ASSERT_ON_ERROR(status);
+        batch[num++] = packet;
+        len += frame_len;
+    }
 
-    status = send_nbytes(sock, packet->packet_data, data_size);
-    OSI_ASSERT_ON_ERROR(status);
+    send_batch(info, batch, num, len);
+}
 
-    return SUCCESS;
+
+/* Single frame is sent right from its packet, no copy is needed */
+static void send_batch(ConnectionInfo *info, Packet **batch, _u8 num, _u16 len) {
+    _u16 offset = 0;
+
+    if(num == 0) {
+        return;
+    }
+
+    OSI_COMMON_LOG("Sending %d packets to %d\r\n", num, info->hndl);
+
+    if(num == 1) {
+        send_packet(info->hndl, batch[0]);
+    }
+    else {
+        for(_u8 i=0; i<num; i++) {
+            _u16 frame_len = PACKET_HEADER_SIZE + batch[i]->header.data_size;
+
+            memcpy(tx_buf + offset, batch[i]->raw_header, frame_len);
+            offset += frame_len;
+        }
+
+        send_nbytes(info->hndl, tx_buf, len);
+    }
+
+    info->tx_frames += num;
+    info->tx_sends++;
+
+    release_packets(batch, num);
+    pool_starved = FALSE;
 }
 
 
-static _i16 recv_packet(_i16 sock, Packet *packet) {
+/* Header and data are contiguous in Packet, one call sends frame */
+static _i16 send_packet(_i16 sock, Packet *packet) {
     _i16 status;
-    _u16 packet_size;
 
-    /* Trying to receive header */
-    OSI_COMMON_LOG("Receiving header\r\n");
-    status = recv_nbytes(sock, packet->raw_header, PACKET_HEADER_SIZE);
+    status = send_nbytes(sock, packet->raw_header, PACKET_HEADER_SIZE + packet->header.data_size);
     OSI_ASSERT_ON_ERROR(status);
 
-    /* Parsing header */
-    status = parse_header(packet->raw_header, &(packet->header));
-    OSI_ASSERT_ON_ERROR(status);
+    return SUCCESS;
+}
 
-    /* Receiving body */
-    OSI_COMMON_LOG("Receiving body\r\n");
-    packet_size = packet->header.data_size;
 
-    if(packet_size > 0) {
-        status = recv_nbytes(sock, packet->packet_data, packet_size);
-        OSI_ASSERT_ON_ERROR(status);
+/*
+ * ************************************************************
+ * Reads whatever socket has for the frame being reassembled,
+ * header first and then body. Never reads beyond the frame, so
+ * the next one stays in socket.
+ *
+ * Returns 1 when frame is complete, 0 when more bytes are
+ * needed and negative value when connection must be closed.
+ * ************************************************************
+ */
+static _i16 receive_frame(ConnectionInfo *info) {
+    _i16 status;
+    Packet *packet;
+
+    if(info->rx_packet == NULL) {
+        if(get_packet_from_pool(&info->rx_packet) < 0) {
+            info->rx_packet = NULL;
+            pool_starved = TRUE;
+            return 0;
+        }
+
+        info->rx_state = RX_HEADER;
+        info->rx_received = 0;
     }
 
-    return status;
-}
+    packet = info->rx_packet;
 
+    for( ;; ) {
+        _u8 *buf = packet->raw_header;
+        _u16 expected = PACKET_HEADER_SIZE;
+
+        if(info->rx_state == RX_BODY) {
+            buf = packet->packet_data;
+            expected = packet->header.data_size;
+        }
 
-static _i16 recv_nbytes(_i16 sock, _u8 *buf, _u16 n) {
-    _i16 remaining_bytes = n;
-    _i16 recv_bytes;
+        if(info->rx_received < expected) {
+            status = recv(info->hndl, buf + info->rx_received, expected - info->rx_received, 0);
 
-    while(remaining_bytes != 0) {
-        recv_bytes = recv(sock, buf, remaining_bytes, 0);
+            if(status == EAGAIN) {
+                return 0;
+            }
+            else if(status <= 0) {
+                OSI_ERROR_LOG(status);
+                return (status < 0) ? status : FAILURE;
+            }
 
-        if(recv_bytes > 0) {
-            OSI_COMMON_LOG("Remaining: %d. Received %d bytes. The rest: %d\r\n", remaining_bytes,
-                           recv_bytes, remaining_bytes-recv_bytes);
-            remaining_bytes -= recv_bytes;
+            info->rx_received += status;
+            continue;
         }
-        else if(recv_bytes != EAGAIN) {
-            OSI_ERROR_LOG(recv_bytes)
-            return recv_bytes;
+
+        if(info->rx_state == RX_BODY) {
+            info->rx_state = RX_COMPLETE;
+            return 1;
         }
-        else {
-            osi_Sleep(1);
+
+        status = parse_header(packet->raw_header, &packet->header);
+        OSI_ASSERT_ON_ERROR(status);
+
+        /* Protocol allows more than one pooled packet holds */
+        if(packet->header.data_size > sizeof packet->packet_data) {
+            OSI_COMMON_LOG("Frame body of %u bytes is too long\r\n", packet->header.data_size);
+            return FAILURE;
         }
+
+        info->rx_state = RX_BODY;
+        info->rx_received = 0;
     }
+}
 
-    return SUCCESS;
+
+/*
+ * Hands complete packet over to controller. Programmer packet
+ * waits in connection while both programmer slots are taken.
+ */
+static void dispatch_packet(ConnectionInfo *info) {
+    _i16 status;
+    Packet *packet = info->rx_packet;
+
+    if(!controller_ready(&packet->header)) {
+        return;
+    }
+
+    info->rx_packet = NULL;
+    info->rx_state = RX_HEADER;
+    info->rx_received = 0;
+
+    if(packet->header.type == CloseConnectionPacket) {
+        OSI_COMMON_LOG("Closing connection\r\n");
+        release_packet(packet);
+        close_conn(info);
+        return;
+    }
+
+    status = process_packet(&info->out_queue, packet);
+
+    /* Programmer task releases packets it takes */
+    if(status != CONTROLLER_PACKET_TAKEN) {
+        status = release_packet(packet);
+        OSI_ASSERT_WITHOUT_EXIT(status);
+    }
 }
 
 
+/* Socket may take a part of buffer, the rest is sent again */
 static _i16 send_nbytes(_i16 sock, _u8 *buf, _u16 n) {
-    _i16 status = EAGAIN;
+    _i16 status;
 
-    while(status == EAGAIN) {
+    while(n > 0) {
         status = send(sock, buf, n, 0);
 
-        if(status < 0 && status != EAGAIN) {
+        if(status > 0) {
+            buf += status;
+            n -= status;
+        }
+        else if(status != EAGAIN) {
             return status;
         }
     }
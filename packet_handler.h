@@ -6,6 +6,14 @@
 #include "packets.h"
 
 
+/* Reassembly of incoming frame */
+typedef enum {
+    RX_HEADER = 0,
+    RX_BODY,
+    RX_COMPLETE
+} RxState;
+
+
 typedef struct _connection_info {
 
     _i16            hndl;
@@ -14,11 +22,21 @@ typedef struct _connection_info {
     OsiMsgQ_t       in_queue;
     OsiMsgQ_t       out_queue;
 
+    /* Frame being received, bytes of current part read so far */
+    RxState         rx_state;
+    Packet          *rx_packet;
+    _u16            rx_received;
+
+    /* Frames sent and send() calls made for them */
+    _u32            tx_frames;
+    _u32            tx_sends;
+
 } ConnectionInfo;
 
 
 _i8 packet_handler_start(void);
 _i8 packet_handler_stop(void);
+void packet_handler_wake(void);
 
 
 #endif // PACKET_HANDLER_H_INCLUDED
@@ -4,23 +4,54 @@
 #include "osi.h"
 
 #include "programmer_parser.h"
+#include "packet_handler.h"
 #include "logging.h"
 
 
-static inline _i16 write_packet(Packet *packet, OsiMsgQ_t *out_queue) {
+/* Time to wait for room in outgoing queue */
+#define PACKET_QUEUE_WAIT_MS    10
+
+
+/*
+ * Packet goes back to pool if it can not be queued. Otherwise
+ * handling task is woken to send it.
+ */
+static inline _i16 write_packet(Packet *packet, OsiMsgQ_t *out_queue, OsiTime_t timeout) {
     _i16 status;
 
-    status = sys_queue_write_ptr(out_queue, packet, 10);
+    status = sys_queue_write_ptr(out_queue, packet, timeout);
+    if(status < 0) {
+        release_packet(packet);
+    }
+    else {
+        packet_handler_wake();
+    }
+
     return status;
 }
 
 
 _i16 send_ack(_i16 status, OsiMsgQ_t *out_queue) {
+    return send_ack_data(status, NULL, 0, out_queue);
+}
+
+
+/* ACK followed by additional data describing result */
+_i16 send_ack_data(_i16 status, _u8 *data, _u16 data_len, OsiMsgQ_t *out_queue) {
     _i16 send_status;
-    _u8 ack_data[1];
+    _u8 ack_data[PL_ACK_MAX_DATA_SIZE + 1];
+
+    if(data_len > PL_ACK_MAX_DATA_SIZE) {
+        return -1;
+    }
+
     set_ack_data(ack_data, status);
 
-    send_status = create_send_packet(ACKPacket, ack_data, 1, out_queue);
+    if(data != NULL && data_len != 0) {
+        memcpy(ack_data + 1, data, data_len);
+    }
+
+    send_status = create_send_packet(ACKPacket, ack_data, data_len + 1, out_queue);
     OSI_ASSERT_ON_ERROR(send_status);
 
     return send_status;
@@ -56,9 +87,12 @@ _i16 create_send_packet(PacketType type, _u8 *data, _u16 data_len, OsiMsgQ_t *ou
 
     status = create_packet(packet, type, COMPRESSION_OFF, SIGN_OFF, ENCRYPTION_OFF,
                 data, data_len);
-    OSI_ASSERT_ON_ERROR(status);
+    if(status < 0) {
+        release_packet(packet);
+        OSI_ASSERT_ON_ERROR(status);
+    }
 
-    write_packet(packet, out_queue);
+    status = write_packet(packet, out_queue, PACKET_QUEUE_WAIT_MS);
     return status;
 }
 
@@ -69,9 +103,46 @@ _i16 send_packet(Packet *packet, PacketType type, _u16 data_len, OsiMsgQ_t *out_
     /* Will not change packet_data field */
     status = create_packet(packet, type, COMPRESSION_OFF, SIGN_OFF, ENCRYPTION_OFF,
                            NULL, data_len);
-    OSI_ASSERT_ON_ERROR(status);
+    if(status < 0) {
+        release_packet(packet);
+        OSI_ASSERT_ON_ERROR(status);
+    }
+
+    status = write_packet(packet, out_queue, PACKET_QUEUE_WAIT_MS);
+    return status;
+}
+
+
+/*
+ * Same as send_packet() but waits till there is room in queue
+ * while stream is active. Packet is dropped once active is cleared,
+ * e.g. when connection is closed and nobody empties queue.
+ * Must not be called from handling task as it is the one
+ * which empties queue.
+ */
+_i16 stream_packet(Packet *packet, PacketType type, _u16 data_len, OsiMsgQ_t *out_queue,
+                   volatile _u8 *active)
+{
+    _i16 status;
+
+    status = create_packet(packet, type, COMPRESSION_OFF, SIGN_OFF, ENCRYPTION_OFF,
+                           NULL, data_len);
+    if(status < 0) {
+        release_packet(packet);
+        OSI_ASSERT_ON_ERROR(status);
+    }
+
+    do {
+        status = sys_queue_write_ptr(out_queue, packet, PACKET_QUEUE_WAIT_MS);
+    } while(status < 0 && *active);
+
+    if(status < 0) {
+        release_packet(packet);
+    }
+    else {
+        packet_handler_wake();
+    }
 
-    write_packet(packet, out_queue);
     return status;
 }
 
@@ -86,9 +157,9 @@ _i16 read_packet(Packet **packet, OsiMsgQ_t *in_queue, _u8 timeout) {
 
 void set_ack_data(_u8 *data, _i16 success) {
     if(success >= 0) {
-        data[0] = 1;
+        data[PL_ACK_BYTE_OFFSET] = PL_ACK_SUCCESS;
     }
     else {
-        data = 0;
+        data[PL_ACK_BYTE_OFFSET] = PL_ACK_FAILURE;
     }
 }
@@ -1,5 +1,6 @@
 #include "packets.h"
 #include "pool.h"
+#include "osi.h"
 #include "common.h"
 #include "logging.h"
 
@@ -12,8 +13,50 @@ static PacketType   get_uart_packet_type(_u8 _type);
 static inline _u8   get_flag_bit(_u8 *header, _u8 bit);
 static inline void  set_flag_bit(_u8 *header, _u8 bit);
 
-/* Pool for packets */
+/* Pool for packets. Shared by handling and programmer tasks */
 static pool_t       packets_pool;
+static OsiLockObj_t packets_pool_lock;
+
+/* Mapping from PacketType to PL type byte */
+static const _u8    pl_types[PacketsNumber] = {
+    [ProgrammerInitPacket] = PL_PROGRAMMER_INIT,
+    [ProgrammerStopPacket] = PL_PROGRAMMER_STOP,
+    [UartInitPacket] = PL_UART_INIT,
+    [UartStopPacket] = PL_UART_STOP,
+    [ResetPacket] = PL_RESET,
+    [ACKPacket] = PL_ACK_PACKET,
+    [CloseConnectionPacket] = PL_CLOSE_CONNECTION,
+    [NetworkConfigurationPacket] = PL_NETWORK_CONFIGURATION,
+    [EnableEncryptionPacket] = PL_ENABLE_ENCRYPTION,
+    [EnableSignPacket] = PL_ENABLE_SIGN,
+    [EncryptionConfigPacket] = PL_SET_ENCRYPTION_KEYS,
+    [SignConfigPacket] = PL_SET_SIGN_KEYS,
+    [ObserverKeyPacket] = PL_SET_OBSERVER_KEY,
+    [ErrorPacket] = PL_ERROR_PACKET,
+
+    /* Programmer packets */
+    [LoadMCUInfoPacket] = PL_LOAD_MCU_INFO,
+    [ProgramMemoryPacket] = PL_PROGRAM_MEMORY,
+    [ReadMemoryPacket] = PL_READ_MEMORY,
+    [MemoryPacket] = PL_MEMORY,
+    [CMDPacket] = PL_CMD,
+    [ProgramWindowPacket] = PL_PROGRAM_WINDOW,
+    [ProgramAckPacket] = PL_PROGRAM_ACK,
+    [ImageBeginPacket] = PL_IMAGE_BEGIN,
+    [ImageDataPacket] = PL_IMAGE_DATA,
+    [ProgramImagePacket] = PL_PROGRAM_IMAGE,
+    [ChipErasePacket] = PL_CHIP_ERASE,
+    [PageCrcRequestPacket] = PL_PAGE_CRC_REQUEST,
+    [PageCrcPacket] = PL_PAGE_CRC,
+    [SelectPartPacket] = PL_SELECT_PART,
+    [VerifyPacket] = PL_VERIFY,
+    [FusesPacket] = PL_FUSES,
+    [ProgramHexPacket] = PL_PROGRAM_HEX,
+
+    /* UART packets */
+    [UartConfigurationPacket] = PL_UART_CONFIGURATION,
+    [UartDataPacket] = PL_UART_DATA
+};
 
 
 _i16 create_packet(Packet *packet, PacketType type, _u8 comp,
@@ -21,6 +64,7 @@ _i16 create_packet(Packet *packet, PacketType type, _u8 comp,
     _i16 status;
 
     PacketHeader *header = &packet->header;
+    header->type = type;
     header->compression = comp;
     header->sign = sign;
     header->encryption = enc;
@@ -38,6 +82,11 @@ _i16 create_packet(Packet *packet, PacketType type, _u8 comp,
 
 
 _i16 initialize_packets_pool(_u8 num) {
+    _i16 status;
+
+    status = osi_LockObjCreate(&packets_pool_lock);
+    OSI_ASSERT_ON_ERROR(status);
+
     pool_create(&packets_pool, NULL, sizeof(Packet), num);
 
     return 0;
@@ -45,12 +94,40 @@ _i16 initialize_packets_pool(_u8 num) {
 
 
 _i16 get_packet_from_pool(Packet **packet) {
-    return pool_get(&packets_pool, (void**)packet);
+    _i16 status;
+
+    osi_LockObjLock(&packets_pool_lock, OSI_WAIT_FOREVER);
+    status = pool_get(&packets_pool, (void**)packet);
+    osi_LockObjUnlock(&packets_pool_lock);
+
+    return status;
 }
 
 
 _i16 release_packet(Packet *packet) {
-    return pool_release(&packets_pool, packet);
+    _i16 status;
+
+    osi_LockObjLock(&packets_pool_lock, OSI_WAIT_FOREVER);
+    status = pool_release(&packets_pool, packet);
+    osi_LockObjUnlock(&packets_pool_lock);
+
+    return status;
+}
+
+
+/* Same as release_packet() for several packets under one lock */
+_i16 release_packets(Packet **packets, _u8 num) {
+    _i16 status = 0;
+
+    osi_LockObjLock(&packets_pool_lock, OSI_WAIT_FOREVER);
+
+    for(_u8 i=0; i<num && status >= 0; i++) {
+        status = pool_release(&packets_pool, packets[i]);
+    }
+
+    osi_LockObjUnlock(&packets_pool_lock);
+
+    return status;
 }
 
 
@@ -112,6 +189,7 @@ _i16 update_header(Packet *packet) {
     }
 
     raw_header[0] = PL_START_FRAME_BYTE;
+    raw_header[PL_TYPE_FIELD_OFFSET] = pl_types[header.type];
 
     for(int i=0; i<PL_SIZE_FIELD_SIZE; i++) {
         raw_header[PL_SIZE_FIELD_OFFSET+i] = (data_size >> 8*(PL_SIZE_FIELD_SIZE-i-1)) & 0xFF;
@@ -156,6 +234,18 @@ static char* packets_types[PacketsNumber] = {
     [ReadMemoryPacket] = "Read memory packet",
     [MemoryPacket] = "Memory packet",
     [CMDPacket] = "CMD packet",
+    [ProgramWindowPacket] = "Program window packet",
+    [ProgramAckPacket] = "Program ACK packet",
+    [ImageBeginPacket] = "Image begin packet",
+    [ImageDataPacket] = "Image data packet",
+    [ProgramImagePacket] = "Program image packet",
+    [ChipErasePacket] = "Chip erase packet",
+    [PageCrcRequestPacket] = "Page CRC request packet",
+    [PageCrcPacket] = "Page CRC packet",
+    [SelectPartPacket] = "Select part packet",
+    [VerifyPacket] = "Verify packet",
+    [FusesPacket] = "Fuses packet",
+    [ProgramHexPacket] = "Program HEX packet",
 
     /* UART packets */
     [UartConfigurationPacket] = "UART config packet",
@@ -271,6 +361,54 @@ static PacketType get_programmer_packet_type(_u8 _type) {
             type = CMDPacket;
             break;
 
+        case PL_PROGRAM_WINDOW:
+            type = ProgramWindowPacket;
+            break;
+
+        case PL_PROGRAM_ACK:
+            type = ProgramAckPacket;
+            break;
+
+        case PL_IMAGE_BEGIN:
+            type = ImageBeginPacket;
+            break;
+
+        case PL_IMAGE_DATA:
+            type = ImageDataPacket;
+            break;
+
+        case PL_PROGRAM_IMAGE:
+            type = ProgramImagePacket;
+            break;
+
+        case PL_CHIP_ERASE:
+            type = ChipErasePacket;
+            break;
+
+        case PL_PAGE_CRC_REQUEST:
+            type = PageCrcRequestPacket;
+            break;
+
+        case PL_PAGE_CRC:
+            type = PageCrcPacket;
+            break;
+
+        case PL_SELECT_PART:
+            type = SelectPartPacket;
+            break;
+
+        case PL_VERIFY:
+            type = VerifyPacket;
+            break;
+
+        case PL_FUSES:
+            type = FusesPacket;
+            break;
+
+        case PL_PROGRAM_HEX:
+            type = ProgramHexPacket;
+            break;
+
         case PL_ERROR_PACKET:
             type = ErrorPacket;
             break;
@@ -11,6 +11,9 @@
 
 #define PACKET_HEADER_SIZE          PL_PACKET_HEADER_SIZE
 
+/* Puts the end of raw header on word boundary, see Packet */
+#define PACKET_HEADER_PAD           (4 - PACKET_HEADER_SIZE % 4)
+
 
 #define COMPRESSION_ON  1
 #define COMPRESSION_OFF 0
@@ -54,6 +57,18 @@ typedef enum {
     ReadMemoryPacket,
     MemoryPacket,
     CMDPacket,
+    ProgramWindowPacket,
+    ProgramAckPacket,
+    ImageBeginPacket,
+    ImageDataPacket,
+    ProgramImagePacket,
+    ChipErasePacket,
+    PageCrcRequestPacket,
+    PageCrcPacket,
+    SelectPartPacket,
+    VerifyPacket,
+    FusesPacket,
+    ProgramHexPacket,
 
     /* UART packets */
     UartConfigurationPacket,
@@ -64,7 +79,7 @@ typedef enum {
 
 
 #define CONTROL_PACKETS_NUM         (ObserverKeyPacket+1)
-#define PROGRAMMER_PACKETS_NUM      (CMDPacket - LoadMCUInfoPacket + 1)
+#define PROGRAMMER_PACKETS_NUM      (ProgramHexPacket - LoadMCUInfoPacket + 1)
 #define UART_PACKETS_NUM            (UartDataPacket - UartConfigurationPacket + 1)
 
 #define CONTROL_PACKETS_SHIFT       (0)
@@ -88,8 +103,14 @@ typedef struct packet_header {
 typedef struct packet {
 
     PacketHeader        header;
+
+    /*
+     * Raw header is followed by data with no gap, so the whole
+     * frame is sent at once, and data starts on word boundary.
+     */
+    _u8                 header_pad[PACKET_HEADER_PAD];
     _u8                 raw_header[PL_PACKET_HEADER_SIZE];
-    _u8                 packet_data[1024];
+    _u8                 packet_data[PL_PACKET_DATA_SIZE];
 
 } Packet;
 
@@ -101,6 +122,7 @@ _i16     update_header(Packet *packet);
 _i16     initialize_packets_pool(_u8 num);
 _i16     get_packet_from_pool(Packet **packet);
 _i16     release_packet(Packet *packet);
+_i16     release_packets(Packet **packets, _u8 num);
 
 PacketGroup     get_type_group(PacketType type);
 void            print_packet(Packet *packet);
@@ -53,6 +53,13 @@
 
 #include "config.h"
 
+static const unsigned long gang_reset_pins[GANG_MAX_TARGETS] = GANG_RESET_PINS;
+static const unsigned char gang_reset_gpios[GANG_MAX_TARGETS] = GANG_RESET_GPIOS;
+static const unsigned long gang_select_pins[GANG_MAX_TARGETS] = GANG_SELECT_PINS;
+static const unsigned char gang_select_gpios[GANG_MAX_TARGETS] = GANG_SELECT_GPIOS;
+
+static void PinConfigGPIOOut(unsigned long pin, unsigned char gpio_num);
+
 //*****************************************************************************
 void
 PinMuxConfig(void)
@@ -76,12 +83,19 @@ PinMuxConfig(void)
 
     /****** MCU RESET *******/
     PRCMPeripheralClkEnable(PRCM_GPIOA0, PRCM_RUN_MODE_CLK);
+    PRCMPeripheralClkEnable(PRCM_GPIOA1, PRCM_RUN_MODE_CLK);
+    PRCMPeripheralClkEnable(PRCM_GPIOA2, PRCM_RUN_MODE_CLK);
+    PRCMPeripheralClkEnable(PRCM_GPIOA3, PRCM_RUN_MODE_CLK);
 
     //
-    // Configure PIN_61 for GPIO Output
+    // Configure reset and MISO select of gang targets for GPIO Output.
+    // Target 0 reset is PIN_61.
     //
-    PinTypeGPIO(PIN_61, PIN_MODE_0, false);
-    GPIODirModeSet(GPIOA0_BASE, 0x40, GPIO_DIR_MODE_OUT);
+    for(int i=0; i<GANG_MAX_TARGETS; i++)
+    {
+        PinConfigGPIOOut(gang_reset_pins[i], gang_reset_gpios[i]);
+        PinConfigGPIOOut(gang_select_pins[i], gang_select_gpios[i]);
+    }
 
 
     /***** UART1 ******/
@@ -113,3 +127,14 @@ PinMuxConfig(void)
     // SS
     MAP_PinTypeSPI(PIN_08, PIN_MODE_7);
 }
+
+
+//*****************************************************************************
+static void
+PinConfigGPIOOut(unsigned long pin, unsigned char gpio_num)
+{
+    unsigned long port = GPIOA0_BASE + (gpio_num / 8) * (GPIOA1_BASE - GPIOA0_BASE);
+
+    PinTypeGPIO(pin, PIN_MODE_0, false);
+    GPIODirModeSet(port, 1 << (gpio_num % 8), GPIO_DIR_MODE_OUT);
+}
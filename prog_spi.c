@@ -0,0 +1,174 @@
+#include "prog_spi.h"
+
+#include "hw_types.h"
+#include "hw_memmap.h"
+#include "hw_mcspi.h"
+#include "hw_ints.h"
+#include "interrupt.h"
+#include "rom_map.h"
+#include "prcm.h"
+#include "spi.h"
+#include "udma.h"
+#include "udma_if.h"
+
+#include "osi.h"
+#include "config.h"
+#include "logging.h"
+
+
+/* Shorter transfers are not worth DMA setup */
+#define SPI_DMA_THRESHOLD       16
+
+/* Maximum items of single uDMA transfer */
+#define SPI_DMA_MAX_CHUNK       1024
+
+/* Time to wait for DMA transfer to complete */
+#define SPI_DMA_TIMEOUT_MS      100
+
+
+/* Signalled from interrupt when DMA transfer is over */
+static OsiSyncObj_t     transfer_done;
+
+static _u8              initialized = FALSE;
+
+
+static void spi_irq_hndl(void);
+static _i16 spi_dma_transfer(_u8 *tx, _u8 *rx, _u16 len);
+
+
+/*
+ * ************************************************************
+ * Must be called once before transfers. uDMA itself is
+ * initialized by wired configurator at startup.
+ * ************************************************************
+ */
+void prog_spi_init(void) {
+    if(initialized) {
+        return;
+    }
+
+    osi_SyncObjCreate(&transfer_done);
+
+    MAP_SPIIntRegister(PROG_SPI_BASE, spi_irq_hndl);
+    MAP_IntPrioritySet(PROG_SPI_INT, PROG_SPI_INT_PRIORITY);
+    initialized = TRUE;
+}
+
+
+void prog_spi_configure(_u32 spi_rate) {
+    prog_spi_disable();
+
+    MAP_SPIReset(PROG_SPI_BASE);
+    MAP_SPIConfigSetExpClk(PROG_SPI_BASE,
+                           MAP_PRCMPeripheralClockGet(PRCM_GSPI),
+                           spi_rate,
+                           SPI_MODE_MASTER,
+                           SPI_SUB_MODE_0,
+                           (SPI_SW_CTRL_CS |
+                            SPI_4PIN_MODE |
+                            SPI_TURBO_OFF |
+                            SPI_CS_ACTIVELOW |
+                            SPI_WL_8));
+
+    MAP_SPIFIFOLevelSet(PROG_SPI_BASE, 1, 1);
+}
+
+
+void prog_spi_enable(void) {
+    MAP_SPIEnable(PROG_SPI_BASE);
+}
+
+
+void prog_spi_disable(void) {
+    MAP_SPIDisable(PROG_SPI_BASE);
+}
+
+
+/*
+ * ************************************************************
+ * Transfers whole buffer under one CS assertion.
+ *
+ * Long transfers run on uDMA in chunks while calling task
+ * sleeps till interrupt wakes it up.
+ * ************************************************************
+ */
+_i16 prog_spi_transfer(_u8 *tx, _u8 *rx, _u16 len) {
+    _i16 status = 0;
+
+    if(len < SPI_DMA_THRESHOLD) {
+        return MAP_SPITransfer(PROG_SPI_BASE, tx, rx, len, SPI_CS_ENABLE | SPI_CS_DISABLE);
+    }
+
+    MAP_SPICSEnable(PROG_SPI_BASE);
+
+    for(_u16 offset=0; offset<len; offset+=SPI_DMA_MAX_CHUNK) {
+        _u16 chunk = len - offset;
+
+        if(chunk > SPI_DMA_MAX_CHUNK) {
+            chunk = SPI_DMA_MAX_CHUNK;
+        }
+
+        status = spi_dma_transfer(tx + offset, rx + offset, chunk);
+        if(status < 0) {
+            break;
+        }
+    }
+
+    MAP_SPICSDisable(PROG_SPI_BASE);
+
+    return status;
+}
+
+
+static _i16 spi_dma_transfer(_u8 *tx, _u8 *rx, _u16 len) {
+    _i16 status;
+
+    osi_SyncObjClear(&transfer_done);
+
+    UDMASetupTransfer(UDMA_CH30_GSPI_RX,
+                      UDMA_MODE_BASIC,
+                      len,
+                      UDMA_SIZE_8,
+                      UDMA_ARB_1,
+                      (void*)(PROG_SPI_BASE + MCSPI_O_RX0),
+                      UDMA_SRC_INC_NONE,
+                      rx,
+                      UDMA_DST_INC_8);
+
+    UDMASetupTransfer(UDMA_CH31_GSPI_TX,
+                      UDMA_MODE_BASIC,
+                      len,
+                      UDMA_SIZE_8,
+                      UDMA_ARB_1,
+                      tx,
+                      UDMA_SRC_INC_8,
+                      (void*)(PROG_SPI_BASE + MCSPI_O_TX0),
+                      UDMA_DST_INC_NONE);
+
+    MAP_SPIWordCountSet(PROG_SPI_BASE, len);
+    MAP_SPIFIFOEnable(PROG_SPI_BASE, SPI_RX_FIFO | SPI_TX_FIFO);
+    MAP_SPIIntEnable(PROG_SPI_BASE, SPI_INT_EOW);
+    MAP_SPIDmaEnable(PROG_SPI_BASE, SPI_RX_DMA | SPI_TX_DMA);
+
+    status = osi_SyncObjWait(&transfer_done, SPI_DMA_TIMEOUT_MS);
+
+    MAP_SPIDmaDisable(PROG_SPI_BASE, SPI_RX_DMA | SPI_TX_DMA);
+    MAP_SPIIntDisable(PROG_SPI_BASE, SPI_INT_EOW);
+    MAP_SPIFIFODisable(PROG_SPI_BASE, SPI_RX_FIFO | SPI_TX_FIFO);
+
+    if(status < 0) {
+        OSI_COMMON_LOG("SPI DMA transfer timeout\r\n");
+    }
+
+    return status;
+}
+
+
+static void spi_irq_hndl(void) {
+    _u32 status = MAP_SPIIntStatus(PROG_SPI_BASE, true);
+    MAP_SPIIntClear(PROG_SPI_BASE, status);
+
+    if(status & SPI_INT_EOW) {
+        osi_SyncObjSignalFromISR(&transfer_done);
+    }
+}
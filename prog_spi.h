@@ -0,0 +1,18 @@
+#ifndef PROG_SPI_H_INCLUDED
+#define PROG_SPI_H_INCLUDED
+
+#include "simplelink.h"
+
+
+/*
+ * The only way programmer.c reaches target, together with reset and
+ * select lines of sys.h. Host checks link test/avr_sim.c instead.
+ */
+void prog_spi_init(void);
+void prog_spi_configure(_u32 spi_rate);
+void prog_spi_enable(void);
+void prog_spi_disable(void);
+_i16 prog_spi_transfer(_u8 *tx, _u8 *rx, _u16 len);
+
+
+#endif // PROG_SPI_H_INCLUDED
@@ -1,9 +1,6 @@
 #include "programmer.h"
+#include "prog_spi.h"
 
-#include "hw_memmap.h"
-#include "rom_map.h"
-#include "prcm.h"
-#include "spi.h"
 #include "config.h"
 
 #include "sys.h"
@@ -15,6 +12,9 @@
 #include "protocol.h"
 
 #include "packet_manager.h"
+#include "crc.h"
+#include "mcu_cache.h"
+#include "avr_parts.h"
 
 
 /* Entering PGM mode parameters */
@@ -22,62 +22,230 @@
 #define PGM_ENABLE_DELAY_MS		5
 #define DELAY_AFTER_RESET_MS	20
 
+/* Write completion polling parameters */
+#define WRITE_POLL_SPIN         4
+#define RDY_BSY_BUSY_BIT        0x01
 
-/* Current SPI bitrate */
-static int spi_bitrate = PROG_SPI_DEFAULT_FREQ;
+/* SPI clock ramp. Every step is checked by reading ID bytes */
+#define SPI_RAMP_ROUNDS         8
+#define SPI_RAMP_ID_BYTES       (MCU_SIGNATURE_SIZE + AVR_WORD_SIZE)
+
+/* Fuse and lock bits write time is 4.5 ms */
+#define FUSE_WAIT_MS            5
+
+/* Chip erase takes up to 10 ms on most parts. Some need more. */
+#define CHIP_ERASE_WAIT_MS      60
+
+/* Maximum instructions transferred under one CS assertion */
+#define BATCH_MAX_CMDS          264
 
-/* Used to resume thread */
-static OsiSyncObj_t resume_obj;
+/* Flash words addressed without Load Extended Address */
+#define EXT_SEGMENT_SHIFT       16
+#define EXT_SEGMENT_UNKNOWN     0xFFFFFFFF
 
-/* Running flag */
-static _u8 running = FALSE;
+/* Bytes read by one batch when computing CRC */
+#define CRC_CHUNK_SIZE          BATCH_MAX_CMDS
 
-/* Contains current MCU info */
+
+/* Current SPI bitrate */
+static _u32 spi_bitrate = PROG_SPI_DEFAULT_FREQ;
+
+/* Contains current MCU info. NULL till info is set. */
+static AvrMcuInfo mcu_info_data;
 static AvrMcuInfo *mcu_info = NULL;
 
-/* Task prototype */
-static void prog_task(void *pvParameters);
+/* Flash is known to be blank so 0xFF words need not be written */
+static _u8 skip_blank = FALSE;
+
+/* 64K-word flash segment selected in target */
+static _u32 ext_segment = EXT_SEGMENT_UNKNOWN;
+
+/*
+ * Gang targets, bit per target. All of them get every instruction,
+ * answers come from the selected one. Failed targets are dropped
+ * till PGM mode is entered again.
+ */
+static _u8 targets_mask = 0x01;
+static _u8 failed_targets = 0;
+static _u8 selected_target = 0;
+
+static const _u8 chip_erase_cmd[AVR_CMD_SIZE] = {0xAC, 0x80, 0x00, 0x00};
+
+/* Same on all parts with extended fuse, indexed by AvrFuse */
+static const _u8 fuse_read_cmds[AVR_FUSES_NUM][AVR_CMD_SIZE] = {
+    [AVR_FUSE_LOCK] = {0x58, 0x00, 0x00, 0x00},
+    [AVR_FUSE_LOW]  = {0x50, 0x00, 0x00, 0x00},
+    [AVR_FUSE_HIGH] = {0x58, 0x08, 0x00, 0x00},
+    [AVR_FUSE_EXT]  = {0x50, 0x08, 0x00, 0x00}
+};
+
+static const _u8 fuse_write_cmds[AVR_FUSES_NUM][AVR_CMD_SIZE] = {
+    [AVR_FUSE_LOCK] = {0xAC, 0xE0, 0x00, 0x00},
+    [AVR_FUSE_LOW]  = {0xAC, 0xA0, 0x00, 0x00},
+    [AVR_FUSE_HIGH] = {0xAC, 0xA8, 0x00, 0x00},
+    [AVR_FUSE_EXT]  = {0xAC, 0xA4, 0x00, 0x00}
+};
+
+static const _u8 calibration_read_cmd[AVR_CMD_SIZE] = {0x38, 0x00, 0x00, 0x00};
 
-/* Static methods prototypes */
-static _i16 read_memory(AvrReadMemData *mem_data, _u8 *buf);
-static _i16 program_memory(AvrProgMemData *mem_data);
+/* Programming Enable used before MCU info is known */
+static const _u8 default_pgm_enable[AVR_CMD_SIZE] = {0xAC, 0x53, 0x00, 0x00};
 
-static inline void spi_enable(void);
-static inline void spi_disable(void);
-static inline void configure_spi(unsigned long spi_rate);
+/* Batch of instructions and answers to them */
+static _u8  batch_tx[BATCH_MAX_CMDS*AVR_CMD_SIZE];
+static _u8  batch_rx[BATCH_MAX_CMDS*AVR_CMD_SIZE];
+static _u16 batch_len = 0;
+
+static _i16 batch_add(AvrCmdTemplate *tmpl, _u32 addr, _u8 input);
+static _i16 batch_add_raw(const _u8 *cmd);
+static _i16 batch_flush(void);
+static _i16 select_ext_segment(_u32 address);
+
+static _i16 read_id_bytes(_u8 *id);
+static _i16 add_signature_reads(void);
+static _i16 check_spi_rate(_u32 rate, _u8 id[][SPI_RAMP_ID_BYTES]);
+static _i16 enable_target_pgm_mode(_u8 target, const _u8 *pgm_enable);
+static void select_miso(_u8 target);
+static _i8 first_live_target(void);
+
+#define TARGET_BIT(target)      (1 << (target))
 
 
 /*******************************************************/
-void programmer_set_mcu_info(AvrMcuInfo *info) {
-    if(mcu_info != NULL) {
-        free(mcu_info);
+/* Info is copied so it may come from any storage. NULL drops it. */
+void programmer_set_mcu_info(const AvrMcuInfo *info) {
+    if(info == NULL) {
+        mcu_info = NULL;
+        return;
+    }
+
+    mcu_info_data = *info;
+    mcu_info = &mcu_info_data;
+}
+
+
+/* NULL till info is set */
+const AvrMcuInfo* programmer_mcu_info(void) {
+    return mcu_info;
+}
+
+
+/*
+ * ************************************************************
+ * Selects targets programmed at once, bit per target. Target 0
+ * alone is the usual single target mode. Takes effect when PGM
+ * mode is entered.
+ * ************************************************************
+ */
+_i16 programmer_set_targets(_u8 mask) {
+    if(mask == 0 || (mask >> GANG_MAX_TARGETS) != 0) {
+        return -1;
     }
 
-    mcu_info = info;
+    targets_mask = mask;
+    return 0;
+}
+
+
+/* Targets which are still in PGM mode and have not failed */
+_u8 programmer_live_targets(void) {
+    return targets_mask & ~failed_targets;
 }
 
 
+_u8 programmer_failed_targets(void) {
+    return failed_targets;
+}
+
+
+/* Drops target, e.g. when verification of it fails */
+void programmer_fail_target(_u8 target) {
+    failed_targets |= TARGET_BIT(target);
+
+    if(target == selected_target && first_live_target() >= 0) {
+        select_miso(first_live_target());
+    }
+}
+
+
+/* Following reads are answered by this target */
+_i16 programmer_select_target(_u8 target) {
+    if(target >= GANG_MAX_TARGETS || !(programmer_live_targets() & TARGET_BIT(target))) {
+        return -1;
+    }
+
+    select_miso(target);
+    return 0;
+}
+
+
+/*
+ * Returns 0 when at least one target has entered programming mode.
+ * The ones which have not are marked failed. Generic Programming
+ * Enable is used while MCU info is not loaded.
+ */
 _i16 programmer_enable_pgm_mode(void) {
-	_u8 res[AVR_CMD_SIZE];
-	_u8 success = 0;
+	const _u8 *pgm_enable = default_pgm_enable;
+
+	if(mcu_info != NULL) {
+	    pgm_enable = mcu_info->pgm_enable;
+	}
 
-    configure_spi(400000);
-    spi_enable();
+    /* Rate of targets with unknown clock. Tuned by programmer_ramp_spi_rate() */
+    spi_bitrate = PROG_SPI_DEFAULT_FREQ;
+
+    prog_spi_init();
+    prog_spi_configure(spi_bitrate);
+    prog_spi_enable();
     osi_Sleep(5);
 
-    sys_reset_mcu(MCU_RESET_ON);
+    /* SCK and MOSI are shared, so targets left out must run */
+    for(_u8 t=0; t<GANG_MAX_TARGETS; t++) {
+        sys_reset_target(t, (targets_mask & TARGET_BIT(t)) ? MCU_RESET_ON : MCU_RESET_OFF);
+    }
     osi_Sleep(50);
 
+    /* Nothing is known about flash contents of a new session */
+    skip_blank = FALSE;
+    ext_segment = EXT_SEGMENT_UNKNOWN;
+    failed_targets = 0;
+
+    for(_u8 t=0; t<GANG_MAX_TARGETS; t++) {
+        if((targets_mask & TARGET_BIT(t)) && enable_target_pgm_mode(t, pgm_enable) < 0) {
+            failed_targets |= TARGET_BIT(t);
+        }
+    }
+
+	if(programmer_live_targets() == 0) {
+        OSI_COMMON_LOG("Failed to enter PGM mode\r\n");
+        prog_spi_disable();
+
+        return -1;
+	}
+
+	select_miso(first_live_target());
+	return 0;
+}
+
+
+/*
+ * Only reset of this target is pulsed on retries. The others
+ * which are already in PGM mode just get extra Programming
+ * Enable instructions.
+ */
+static _i16 enable_target_pgm_mode(_u8 target, const _u8 *pgm_enable) {
+	_u8 res[AVR_CMD_SIZE];
+
+	select_miso(target);
 
 	for(_u32 i=0; i<PGM_ENABLE_RETRIES; i++)
 	{
-		programmer_write_raw_cmd(mcu_info->pgm_enable, res);
+		programmer_write_raw_cmd((_u8*)pgm_enable, res);
 
-		if(res[2] == mcu_info->pgm_enable[1])
+		if(res[2] == pgm_enable[1])
 		{
-			OSI_COMMON_LOG("Successfully entered programming mode. %ul retries\r\n", i+1);
-			success = 1;
-			break;
+			OSI_COMMON_LOG("Target %d entered programming mode. %ul retries\r\n", target, i+1);
+			return 0;
 		}
 		else
 		{
@@ -85,19 +253,258 @@ _i16 programmer_enable_pgm_mode(void) {
 					res[0], res[1], res[2], res[3]);
 
 			osi_Sleep(PGM_ENABLE_DELAY_MS);
-			sys_reset_mcu(MCU_RESET_OFF);
+			sys_reset_target(target, MCU_RESET_OFF);
 			osi_Sleep(PGM_ENABLE_DELAY_MS);
-            sys_reset_mcu(MCU_RESET_ON);
+            sys_reset_target(target, MCU_RESET_ON);
 			osi_Sleep(PGM_ENABLE_DELAY_MS);
 		}
 	}
 
-	if(!success) {
-        OSI_COMMON_LOG("Failed to enter PGM mode\r\n");
-        spi_disable();
-	}
+	OSI_COMMON_LOG("Target %d failed to enter PGM mode\r\n", target);
+	return -1;
+}
+
+
+/*
+ * Targets whose signature differs from the given one are marked
+ * failed. Returns -1 if none is left.
+ */
+_i16 programmer_match_signatures(const _u8 *signature) {
+    _u8 target_signature[MCU_SIGNATURE_SIZE];
+    _u8 selected = selected_target;
+
+    for(_u8 t=0; t<GANG_MAX_TARGETS; t++) {
+        if(programmer_select_target(t) < 0) {
+            continue;
+        }
+
+        if(programmer_read_signature(target_signature) < 0 ||
+           memcmp(target_signature, signature, MCU_SIGNATURE_SIZE) != 0)
+        {
+            OSI_COMMON_LOG("Signature of target %d does not match\r\n", t);
+            failed_targets |= TARGET_BIT(t);
+        }
+    }
+
+    if(programmer_live_targets() == 0) {
+        return -1;
+    }
+
+    if(programmer_select_target(selected) < 0) {
+        select_miso(first_live_target());
+    }
+
+    return 0;
+}
+
+
+static void select_miso(_u8 target) {
+    for(_u8 t=0; t<GANG_MAX_TARGETS; t++) {
+        if(t != target) {
+            sys_select_target(t, MCU_SELECT_OFF);
+        }
+    }
+
+    sys_select_target(target, MCU_SELECT_ON);
+    selected_target = target;
+}
+
 
-	return success;
+static _i8 first_live_target(void) {
+    _u8 live = programmer_live_targets();
+
+    for(_u8 t=0; t<GANG_MAX_TARGETS; t++) {
+        if(live & TARGET_BIT(t)) {
+            return t;
+        }
+    }
+
+    return -1;
+}
+
+
+/*
+ * ************************************************************
+ * Raises SPI clock step by step towards fck/4 of the target.
+ * Rate is lowered to fck/4 if target is slower than start rate,
+ * and kept when fck is not known.
+ *
+ * Signature and the first flash word are read at the start rate
+ * and then compared with ones read at every new rate. The first
+ * mismatch brings the last good rate back. In gang mode every
+ * target is checked as they share the clock.
+ *
+ * Returns SPI rate in use.
+ * ************************************************************
+ */
+_i32 programmer_ramp_spi_rate(void) {
+    _u8 id[GANG_MAX_TARGETS][SPI_RAMP_ID_BYTES];
+    _u8 selected = selected_target;
+    _u32 max_rate;
+
+    /* First flash word is read to check rate */
+    if(mcu_info == NULL) {
+        return -1;
+    }
+
+    max_rate = (_u32)mcu_info->fck_khz * 1000 / 4;
+    if(max_rate > PROG_SPI_MAX_FREQ) {
+        max_rate = PROG_SPI_MAX_FREQ;
+    }
+
+    if(max_rate != 0 && max_rate < spi_bitrate) {
+        spi_bitrate = max_rate;
+        prog_spi_configure(spi_bitrate);
+    }
+
+    for(_u8 t=0; t<GANG_MAX_TARGETS; t++) {
+        if(programmer_select_target(t) == 0 && read_id_bytes(id[t]) < 0) {
+            return -1;
+        }
+    }
+
+    while(spi_bitrate < max_rate) {
+        _u32 rate = spi_bitrate * 2;
+
+        if(rate > max_rate) {
+            rate = max_rate;
+        }
+
+        if(check_spi_rate(rate, id) < 0) {
+            OSI_COMMON_LOG("SPI rate %u failed, back to %u\r\n", rate, spi_bitrate);
+
+            prog_spi_configure(spi_bitrate);
+            if(check_spi_rate(spi_bitrate, id) < 0) {
+                return -1;
+            }
+
+            break;
+        }
+
+        spi_bitrate = rate;
+    }
+
+    programmer_select_target(selected);
+
+    OSI_COMMON_LOG("SPI rate is %u\r\n", spi_bitrate);
+    return spi_bitrate;
+}
+
+
+/* Reads ID bytes of every live target several times at given rate */
+static _i16 check_spi_rate(_u32 rate, _u8 id[][SPI_RAMP_ID_BYTES]) {
+    _u8 read_id[SPI_RAMP_ID_BYTES];
+
+    prog_spi_configure(rate);
+
+    for(_u8 t=0; t<GANG_MAX_TARGETS; t++) {
+        if(programmer_select_target(t) < 0) {
+            continue;
+        }
+
+        for(_u32 i=0; i<SPI_RAMP_ROUNDS; i++) {
+            if(read_id_bytes(read_id) < 0 ||
+               memcmp(read_id, id[t], SPI_RAMP_ID_BYTES) != 0)
+            {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/* Read Signature Byte is the same on all parts */
+_i16 programmer_read_signature(_u8 *signature) {
+    _i16 status;
+
+    status = add_signature_reads();
+    OSI_ASSERT_ON_ERROR(status);
+
+    status = batch_flush();
+    OSI_ASSERT_ON_ERROR(status);
+
+    for(_u8 i=0; i<MCU_SIGNATURE_SIZE; i++) {
+        signature[i] = batch_rx[i*AVR_CMD_SIZE + AVR_CMD_SIZE - 1];
+    }
+
+    return status;
+}
+
+
+/* Signature, calibration, lock and fuse bytes in one transfer */
+_i16 programmer_read_fuses(AvrFuseData *data) {
+    _i16 status;
+    _u8 k = 0;
+
+    status = add_signature_reads();
+    OSI_ASSERT_ON_ERROR(status);
+
+    status = batch_add_raw(calibration_read_cmd);
+    OSI_ASSERT_ON_ERROR(status);
+
+    for(_u8 i=0; i<AVR_FUSES_NUM; i++) {
+        status = batch_add_raw(fuse_read_cmds[i]);
+        OSI_ASSERT_ON_ERROR(status);
+    }
+
+    status = batch_flush();
+    OSI_ASSERT_ON_ERROR(status);
+
+    for(_u8 i=0; i<MCU_SIGNATURE_SIZE; i++) {
+        data->signature[i] = batch_rx[(k++)*AVR_CMD_SIZE + AVR_CMD_SIZE - 1];
+    }
+
+    data->calibration = batch_rx[(k++)*AVR_CMD_SIZE + AVR_CMD_SIZE - 1];
+
+    for(_u8 i=0; i<AVR_FUSES_NUM; i++) {
+        data->fuses[i] = batch_rx[(k++)*AVR_CMD_SIZE + AVR_CMD_SIZE - 1];
+    }
+
+    return status;
+}
+
+
+static _i16 add_signature_reads(void) {
+    _i16 status = 0;
+    _u8 cmd[AVR_CMD_SIZE] = {0x30, 0x00, 0x00, 0x00};
+
+    for(_u8 i=0; i<MCU_SIGNATURE_SIZE; i++) {
+        cmd[2] = i;
+
+        status = batch_add_raw(cmd);
+        OSI_ASSERT_ON_ERROR(status);
+    }
+
+    return status;
+}
+
+
+/* Signature bytes followed by the first flash word */
+static _i16 read_id_bytes(_u8 *id) {
+    _i16 status;
+
+    status = select_ext_segment(0);
+    OSI_ASSERT_ON_ERROR(status);
+
+    status = add_signature_reads();
+    OSI_ASSERT_ON_ERROR(status);
+
+    status = batch_add(&mcu_info->flash_read_lo, 0, 0);
+    OSI_ASSERT_ON_ERROR(status);
+
+    status = batch_add(&mcu_info->flash_read_hi, 0, 0);
+    OSI_ASSERT_ON_ERROR(status);
+
+    status = batch_flush();
+    OSI_ASSERT_ON_ERROR(status);
+
+    for(_u8 i=0; i<SPI_RAMP_ID_BYTES; i++) {
+        id[i] = batch_rx[i*AVR_CMD_SIZE + AVR_CMD_SIZE - 1];
+    }
+
+    return status;
 }
 
 
@@ -114,7 +521,9 @@ _i16 programmer_write_cmd(AvrCommand *cmd, AvrCommand *answer) {
 _i16 programmer_write_raw_cmd(_u8 *cmd, _u8 *answer) {
     _i16 status;
     _u8 temp_answer[AVR_CMD_SIZE];
-    MAP_SPITransfer(PROG_SPI_BASE, cmd, temp_answer, AVR_CMD_SIZE, SPI_CS_ENABLE | SPI_CS_DISABLE);
+
+    status = prog_spi_transfer(cmd, temp_answer, AVR_CMD_SIZE);
+    OSI_ASSERT_ON_ERROR(status);
 
     status = check_cmd_status(cmd, temp_answer);
 
@@ -131,14 +540,95 @@ _i16 programmer_write_raw_cmd(_u8 *cmd, _u8 *answer) {
 /************************************************************/
 /**               PROGRAMMING MEMORY SECTION               **/
 /************************************************************/
-static _i16 load_memory_cmd(_u8 *cmd, _u32 delay);
+
+/* Location used to check write completion by data polling */
+typedef struct {
+    AvrCmdTemplate  *read_cmd;
+    _u32            address;
+    _u8             value;
+} AvrPollTarget;
+
+static _i16 load_memory_cmd(const _u8 *cmd, AvrPollTarget *poll, _u8 timeout_ms);
+static _i16 wait_write_done(AvrPollTarget *poll, _u8 timeout_ms);
+static _i16 poll_write_done(_u8 *cmd, _u8 value, _u8 rdy_bsy, _u8 timeout_ms);
 static _i16 program_eeprom_memory(AvrProgMemData *prog_data);
+static _i16 program_eeprom_pages(AvrProgMemData *prog_data);
+static _i16 commit_eeprom_page(_u32 address, AvrPollTarget *poll);
 static _i16 program_flash_memory(AvrProgMemData *mem_data);
+static _i16 commit_flash_page(_u32 address, AvrPollTarget *poll);
+
+
+/*
+ * ************************************************************
+ * Writes lock and fuse bytes selected by mask, bit per AvrFuse.
+ * Every written byte is read back afterwards, and bits of ones
+ * which differ in implemented bits are set in failed_mask. In gang mode each target
+ * is read back and the ones with wrong bytes are dropped.
+ * ************************************************************
+ */
+_i16 programmer_write_fuses(_u8 mask, const _u8 *values, _u8 *failed_mask) {
+    _i16 status;
+    _u8 cmd[AVR_CMD_SIZE];
+    AvrFuseData read_back;
+    const AvrPart *part;
+
+    *failed_mask = 0;
+
+    for(_u8 i=0; i<AVR_FUSES_NUM; i++) {
+        if(!(mask & (1 << i))) {
+            continue;
+        }
+
+        memcpy(cmd, fuse_write_cmds[i], AVR_CMD_SIZE);
+        cmd[AVR_CMD_SIZE-1] = values[i];
+
+        status = load_memory_cmd(cmd, NULL, FUSE_WAIT_MS);
+        OSI_ASSERT_ON_ERROR(status);
+    }
+
+    for(_u8 t=0; t<GANG_MAX_TARGETS; t++) {
+        _u8 target_failed = 0;
+
+        if(programmer_select_target(t) < 0) {
+            continue;
+        }
+
+        status = programmer_read_fuses(&read_back);
+        OSI_ASSERT_ON_ERROR(status);
+
+        /* Unimplemented bits read as 1. All bits count on unknown parts. */
+        part = avr_parts_find(read_back.signature);
+
+        for(_u8 i=0; i<AVR_FUSES_NUM; i++) {
+            _u8 bits = (part != NULL) ? part->fuse_bits[i] : 0xFF;
+
+            if((mask & (1 << i)) && ((read_back.fuses[i] ^ values[i]) & bits) != 0) {
+                target_failed |= (1 << i);
+            }
+        }
+
+        if(target_failed) {
+            programmer_fail_target(t);
+            *failed_mask |= target_failed;
+        }
+    }
+
+    if(first_live_target() >= 0) {
+        select_miso(first_live_target());
+    }
+
+    return (*failed_mask == 0) ? 0 : -1;
+}
 
 
 _i16 programmer_program_memory(AvrProgMemData *mem_data) {
     _i16 status;
 
+    /* Memory layout is not known till MCU info is set */
+    if(mcu_info == NULL) {
+        return -1;
+    }
+
     if(mem_data->memory_type == MEMORY_FLASH) {
         OSI_COMMON_LOG("Programming flash memory\r\n");
 
@@ -159,35 +649,146 @@ _i16 programmer_program_memory(AvrProgMemData *mem_data) {
 }
 
 
+/*
+ * ************************************************************
+ * Erases flash and EEPROM. Until PGM mode is entered again
+ * flash is known to be blank, so 0xFF words are not loaded and
+ * pages consisting of them are not written at all.
+ * ************************************************************
+ */
+_i16 programmer_chip_erase(void) {
+    _i16 status;
+
+    status = load_memory_cmd(chip_erase_cmd, NULL, CHIP_ERASE_WAIT_MS);
+    OSI_ASSERT_ON_ERROR(status);
+
+    skip_blank = TRUE;
+
+    return status;
+}
+
+
+/*
+ * ************************************************************
+ * Loads words into MCU page buffer and commits page each time
+ * page boundary is crossed. Partially filled page is committed
+ * at the end of data as it is the end of the stream.
+ *
+ * After chip erase blank words are skipped and page is only
+ * committed if something has been loaded into it.
+ *
+ * Start address is a word address.
+ * ************************************************************
+ */
 static _i16 program_flash_memory(AvrProgMemData *mem_data) {
 	if(mem_data->data_len % 2 != 0)
 	{
 		return -1;
 	}
 
-	_i16 status;
+	_i16 status = 0;
 	_u32 address = mem_data->start_address;
-	_u8 answer[AVR_CMD_SIZE];
-	_u8 cmd[AVR_CMD_SIZE];
+	_u32 page_mask = mcu_info->flash_page_size - 1;
+	_u8 page_loaded = FALSE;
+	AvrPollTarget poll = {.read_cmd = NULL};
+
+	for(_u16 i=0; i<mem_data->data_len; i+=2)
+	{
+		_u8 lo = mem_data->data[i];
+		_u8 hi = mem_data->data[i+1];
 
-	_u8 data_byte = 0xFF;
+		if(!skip_blank || lo != 0xFF || hi != 0xFF)
+		{
+		    /* Loading low and high bytes */
+		    status = batch_add(&mcu_info->flash_load_lo, address, lo);
+		    OSI_ASSERT_ON_ERROR(status);
+
+		    status = batch_add(&mcu_info->flash_load_hi, address, hi);
+		    OSI_ASSERT_ON_ERROR(status);
+
+		    /* 0xFF can not be used for data polling */
+		    if(lo != 0xFF) {
+		        poll.read_cmd = &mcu_info->flash_read_lo;
+		        poll.address = address;
+		        poll.value = lo;
+		    }
+		    else if(hi != 0xFF) {
+		        poll.read_cmd = &mcu_info->flash_read_hi;
+		        poll.address = address;
+		        poll.value = hi;
+		    }
+
+		    page_loaded = TRUE;
+		}
 
-	for(_u8 i=0; i<mem_data->data_len; i+=2)
+		address++;
+
+		/* Page buffer is full */
+		if((address & page_mask) == 0 && page_loaded)
+		{
+		    status = commit_flash_page(address - 1, &poll);
+		    OSI_ASSERT_ON_ERROR(status);
+
+		    page_loaded = FALSE;
+		    poll.read_cmd = NULL;
+		}
+	}
+
+	if(page_loaded)
 	{
-		/* Loading low byte */
-		data_byte = mem_data->data[i];
-		create_memory_cmd(mcu_info->flash_load_lo_pattern, mcu_info->flash_load_lo_len,
-                          address, data_byte, cmd);
+	    status = commit_flash_page(address - 1, &poll);
+	    OSI_ASSERT_ON_ERROR(status);
+	}
 
-        status = load_memory_cmd(cmd, mcu_info->flash_wait_ms);
-        OSI_ASSERT_ON_ERROR(status);
+	return status;
+}
+
+
+/*
+ * ************************************************************
+ * Sends batched page loads followed by write of the flash page
+ * containing address and waits till write is finished.
+ * ************************************************************
+ */
+static _i16 commit_flash_page(_u32 address, AvrPollTarget *poll) {
+    _i16 status;
+    _u32 page_address = address & ~((_u32)mcu_info->flash_page_size - 1);
+
+    status = select_ext_segment(page_address);
+    OSI_ASSERT_ON_ERROR(status);
+
+    status = batch_add(&mcu_info->flash_write_page, page_address, 0);
+    OSI_ASSERT_ON_ERROR(status);
+
+    status = batch_flush();
+    OSI_ASSERT_ON_ERROR(status);
+
+    return wait_write_done(poll, mcu_info->flash_wait_ms);
+}
 
-		/* Loading  high byte */
-		data_byte = mem_data->data[i+1];
-		create_memory_cmd(mcu_info->flash_load_hi_pattern, mcu_info->flash_load_hi_len,
-				address, data_byte, cmd);
 
-        status = load_memory_cmd(cmd, mcu_info->flash_wait_ms);
+/* Byte mode is kept for parts without EEPROM page mode */
+static _i16 program_eeprom_memory(AvrProgMemData *prog_data)
+{
+    _i16 status = 0;
+	_u32 address = prog_data->start_address;
+	_u8 cmd[AVR_CMD_SIZE];
+	AvrPollTarget poll = {.read_cmd = &mcu_info->eeprom_read};
+
+	if(mcu_info->eeprom_page_size != 0)
+	{
+	    return program_eeprom_pages(prog_data);
+	}
+
+	for(int i=0; i<prog_data->data_len; i++)
+	{
+		_u8 data_byte = prog_data->data[i];
+		create_memory_cmd(&mcu_info->eeprom_write, address, data_byte, cmd);
+
+		poll.address = address;
+		poll.value = data_byte;
+
+		status = load_memory_cmd(cmd, &poll, mcu_info->eeprom_wait_ms);
 		OSI_ASSERT_ON_ERROR(status);
 
 		address++;
@@ -197,38 +798,162 @@ static _i16 program_flash_memory(AvrProgMemData *mem_data) {
 }
 
 
-static _i16 program_eeprom_memory(AvrProgMemData *prog_data)
+/*
+ * ************************************************************
+ * Same as flash page engine but for EEPROM. Only loaded bytes
+ * are written by MCU, so range does not have to be page aligned.
+ * One write time is spent per page instead of per byte.
+ * ************************************************************
+ */
+static _i16 program_eeprom_pages(AvrProgMemData *prog_data)
 {
-    _i16 status;
+	_i16 status = 0;
 	_u32 address = prog_data->start_address;
-	_u8 answer[4];
-	_u8 cmd[4];
+	_u32 page_mask = mcu_info->eeprom_page_size - 1;
+	_u8 page_loaded = FALSE;
+	AvrPollTarget poll = {.read_cmd = NULL};
 
-	for(int i=0; i<prog_data->data_len; i++)
+	for(_u16 i=0; i<prog_data->data_len; i++)
 	{
 		_u8 data_byte = prog_data->data[i];
-		create_memory_cmd(mcu_info->eeprom_write_pattern, mcu_info->eeprom_write_len,
-				address, data_byte, cmd);
 
-		status = load_memory_cmd(cmd, mcu_info->eeprom_wait_ms);
+		status = batch_add(&mcu_info->eeprom_load_page, address, data_byte);
 		OSI_ASSERT_ON_ERROR(status);
 
+		/* 0xFF can not be used for data polling */
+		if(data_byte != 0xFF)
+		{
+		    poll.read_cmd = &mcu_info->eeprom_read;
+		    poll.address = address;
+		    poll.value = data_byte;
+		}
+
+		page_loaded = TRUE;
 		address++;
+
+		if((address & page_mask) == 0)
+		{
+		    status = commit_eeprom_page(address - 1, &poll);
+		    OSI_ASSERT_ON_ERROR(status);
+
+		    page_loaded = FALSE;
+		    poll.read_cmd = NULL;
+		}
+	}
+
+	if(page_loaded)
+	{
+	    status = commit_eeprom_page(address - 1, &poll);
+	    OSI_ASSERT_ON_ERROR(status);
 	}
 
 	return status;
 }
 
 
-static _i16 load_memory_cmd(_u8 *cmd, _u32 delay) {
+static _i16 commit_eeprom_page(_u32 address, AvrPollTarget *poll) {
     _i16 status;
-    _i8 answer[AVR_CMD_SIZE];
+    _u32 page_address = address & ~((_u32)mcu_info->eeprom_page_size - 1);
 
-    status = programmer_write_raw_cmd(cmd, answer);
+    status = batch_add(&mcu_info->eeprom_write_page, page_address, 0);
     OSI_ASSERT_ON_ERROR(status);
 
-    osi_Sleep(delay);
-    return status;
+    status = batch_flush();
+    OSI_ASSERT_ON_ERROR(status);
+
+    return wait_write_done(poll, mcu_info->eeprom_wait_ms);
+}
+
+
+static _i16 load_memory_cmd(const _u8 *cmd, AvrPollTarget *poll, _u8 timeout_ms) {
+    _i16 status;
+
+    status = programmer_write_raw_cmd((_u8*)cmd, NULL);
+    OSI_ASSERT_ON_ERROR(status);
+
+    return wait_write_done(poll, timeout_ms);
+}
+
+
+/*
+ * ************************************************************
+ * Waits till MCU finishes write operation.
+ *
+ * Poll RDY/BSY is used when part supports it. Otherwise written
+ * location is read back till it returns written value. Value
+ * 0xFF can not be polled so fixed delay is the last resort.
+ *
+ * Timeout is the worst-case write time from MCU info. Fuse
+ * writes and chip erase may come before MCU info is known,
+ * then only the delay is used.
+ *
+ * In gang mode every live target is polled in turn. Targets
+ * which do not finish in time are dropped.
+ * ************************************************************
+ */
+static _i16 wait_write_done(AvrPollTarget *poll, _u8 timeout_ms) {
+    _u8 cmd[AVR_CMD_SIZE];
+    _u8 rdy_bsy = (mcu_info != NULL && mcu_info->rdy_bsy_supported);
+    _u8 selected = selected_target;
+
+    if(rdy_bsy) {
+        create_memory_cmd(&mcu_info->poll_rdy_bsy, 0, 0, cmd);
+    }
+    else if(poll != NULL && poll->read_cmd != NULL && poll->value != 0xFF) {
+        create_memory_cmd(poll->read_cmd, poll->address, 0, cmd);
+    }
+    else {
+        osi_Sleep(timeout_ms);
+        return 0;
+    }
+
+    for(_u8 t=0; t<GANG_MAX_TARGETS; t++) {
+        if(programmer_select_target(t) < 0) {
+            continue;
+        }
+
+        if(poll_write_done(cmd, rdy_bsy ? 0 : poll->value, rdy_bsy, timeout_ms) < 0) {
+            OSI_COMMON_LOG("Write has not finished on target %d in %d ms\r\n", t, timeout_ms);
+            failed_targets |= TARGET_BIT(t);
+        }
+    }
+
+    if(programmer_live_targets() == 0) {
+        return -1;
+    }
+
+    if(programmer_select_target(selected) < 0) {
+        select_miso(first_live_target());
+    }
+
+    return 0;
+}
+
+
+/* Polls selected target with prepared instruction */
+static _i16 poll_write_done(_u8 *cmd, _u8 value, _u8 rdy_bsy, _u8 timeout_ms) {
+    _i16 status;
+    _u8 res[AVR_CMD_SIZE];
+
+    for(_u32 elapsed_ms=0; elapsed_ms<=timeout_ms; elapsed_ms++) {
+        for(_u32 i=0; i<WRITE_POLL_SPIN; i++) {
+            status = programmer_write_raw_cmd(cmd, res);
+            OSI_ASSERT_ON_ERROR(status);
+
+            if(rdy_bsy) {
+                if((res[AVR_CMD_SIZE-1] & RDY_BSY_BUSY_BIT) == 0) {
+                    return 0;
+                }
+            }
+            else if(res[AVR_CMD_SIZE-1] == value) {
+                return 0;
+            }
+        }
+
+        osi_Sleep(1);
+    }
+
+    return -1;
 }
 
 
@@ -236,14 +961,18 @@ static _i16 load_memory_cmd(_u8 *cmd, _u32 delay) {
 /*************************************************************/
 /**                    READ MEMORY SECTION                  **/
 /*************************************************************/
-static _i16 _read_flash_memory(AvrReadMemData *mem_data, _u8 *buf);
-static _i16 _read_eeprom_memory(AvrReadMemData *mem_data, _u8 *buf);
+static _i32 _read_flash_memory(AvrReadMemData *mem_data, _u8 *buf);
+static _i32 _read_eeprom_memory(AvrReadMemData *mem_data, _u8 *buf);
+static _i16 read_memory_cmds(AvrCmdTemplate **read_cmds, _u8 cmds_num, _u8 flash,
+                             _u32 address, _u32 bytes_num, _u8 *buf);
 
 /*
  * **********************************************************
  * Read memory command by command and return packet
  * With read bytes
  *
+ * Returns number of bytes read.
+ *
  * Arguments:
  * 		mem_data	---	Pointer to AvrReadMem data.
  * 							Contains information for reading
@@ -251,11 +980,16 @@ static _i16 _read_eeprom_memory(AvrReadMemData *mem_data, _u8 *buf);
  * 		buf			---	buffer to save data into.
  * ***********************************************************
  */
-_i16 programmer_read_memory(AvrReadMemData *mem_data, _u8 *buf)
+_i32 programmer_read_memory(AvrReadMemData *mem_data, _u8 *buf)
 {
-	_i16 status;
+	_i32 status;
 	//_log_read_mem_info(mem_data);
 
+	if(mcu_info == NULL)
+	{
+		return -1;
+	}
+
 	if(mem_data->mem_t == MEMORY_FLASH)
 	{
 		OSI_COMMON_LOG("Reading flash memory");
@@ -281,7 +1015,8 @@ _i16 programmer_read_memory(AvrReadMemData *mem_data, _u8 *buf)
 
 /*
  * ************************************************************
- * Reads chunk of flash memory into given buffer
+ * Reads chunk of flash memory into given buffer.
+ * Every word is stored low byte first as in image.
  *
  * Arguments:
  * 	AvrReadMemData *mem_data	---	contains information about
@@ -289,66 +1024,203 @@ _i16 programmer_read_memory(AvrReadMemData *mem_data, _u8 *buf)
  *
  * 	_u8 *buf				---	used to save data into it
  */
-static _i16 _read_flash_memory(AvrReadMemData *mem_data, _u8 *buf)
+static _i32 _read_flash_memory(AvrReadMemData *mem_data, _u8 *buf)
 {
     _i16 status;
-	_u32 address = mem_data->start_address;
-	_u8 answer_counter = 0;
+    AvrCmdTemplate *read_cmds[] = {&mcu_info->flash_read_lo, &mcu_info->flash_read_hi};
 
-	_u8 cmd[AVR_CMD_SIZE];
-	_u8 res[AVR_CMD_SIZE];
+    if(mem_data->bytes_to_read % 2 != 0) {
+        return -1;
+    }
 
-	for(int i=0; i<mem_data->bytes_to_read; i+=2)
-	{
-	    /* Read high byte */
-		create_memory_cmd(mcu_info->flash_read_hi_pattern, mcu_info->flash_read_hi_len,
-				address, 0, cmd);
+    status = read_memory_cmds(read_cmds, 2, TRUE, mem_data->start_address,
+                              mem_data->bytes_to_read, buf);
+    OSI_ASSERT_ON_ERROR(status);
 
-		status = programmer_write_raw_cmd(cmd, res);
-		OSI_ASSERT_ON_ERROR(status);
+	return mem_data->bytes_to_read;
+}
 
-		buf[answer_counter++] = res[AVR_CMD_SIZE-1];
 
-		/* Read low byte */
-		create_memory_cmd(mcu_info->flash_read_lo_pattern, mcu_info->flash_read_lo_len,
-				address, 0, cmd);
+static _i32 _read_eeprom_memory(AvrReadMemData *mem_info, _u8 *buf)
+{
+    _i16 status;
+    AvrCmdTemplate *read_cmds[] = {&mcu_info->eeprom_read};
 
-		status = programmer_write_raw_cmd(cmd, res);
-		OSI_ASSERT_ON_ERROR(status);
+    status = read_memory_cmds(read_cmds, 1, FALSE, mem_info->start_address,
+                              mem_info->bytes_to_read, buf);
+    OSI_ASSERT_ON_ERROR(status);
 
-		buf[answer_counter++] = res[AVR_CMD_SIZE-1];
-		address++;
-	}
+	return mem_info->bytes_to_read;
+}
 
-	return mem_data->bytes_to_read;
+
+/*
+ * ************************************************************
+ * Computes CRC32 of every flash page in range. Address is a
+ * word address and is aligned down to the page.
+ * ************************************************************
+ */
+_i16 programmer_flash_page_crcs(_u32 address, _u16 pages, _u32 *crcs) {
+    _u32 crc;
+    _u32 page_words;
+    AvrReadMemData range = {.mem_t = MEMORY_FLASH};
+
+    if(mcu_info == NULL) {
+        return -1;
+    }
+
+    page_words = mcu_info->flash_page_size;
+    range.start_address = address & ~(page_words - 1);
+    range.bytes_to_read = (_u32)pages * page_words * AVR_WORD_SIZE;
+
+    return programmer_memory_crc(&range, &crc, crcs, pages);
 }
 
 
-static _i16 _read_eeprom_memory(AvrReadMemData *mem_info, _u8 *buf)
+/*
+ * ************************************************************
+ * Computes CRC32 of memory range batch by batch, so verifying
+ * takes SPI time only. For flash CRC of every page touched by
+ * range is stored too, up to pages_num of them. The first and
+ * the last pages may be partial.
+ *
+ * Flash address is a word address. Words are fed low byte
+ * first, so CRC matches the one of the image.
+ * ************************************************************
+ */
+_i16 programmer_memory_crc(AvrReadMemData *range, _u32 *crc,
+                           _u32 *page_crcs, _u16 pages_num)
 {
-    _i16 status;
-	_u32 address = mem_info->start_address;
-	_u16 answer_counter = 0;
+    _i16 status = 0;
+    _u8 buf[CRC_CHUNK_SIZE];
+    AvrCmdTemplate *read_cmds[2];
+    _u8 cmds_num;
+    _u32 address = range->start_address;
+    _u32 page_words;
+    _u32 page_crc = CRC32_INIT;
+    _u16 page = 0;
+    _u32 addr_left;
+
+    if(mcu_info == NULL) {
+        return -1;
+    }
 
-	_u8 cmd[AVR_CMD_SIZE];
-	_u8 res[AVR_CMD_SIZE];
+    page_words = mcu_info->flash_page_size;
+
+    if(range->mem_t == MEMORY_FLASH) {
+        read_cmds[0] = &mcu_info->flash_read_lo;
+        read_cmds[1] = &mcu_info->flash_read_hi;
+        cmds_num = 2;
+    }
+    else if(range->mem_t == MEMORY_EEPROM) {
+        read_cmds[0] = &mcu_info->eeprom_read;
+        cmds_num = 1;
+        page_crcs = NULL;
+    }
+    else {
+        return -1;
+    }
 
-	char 	*read_pattern 	 = mcu_info->eeprom_read_pattern;
-	_u8 read_pattern_len = mcu_info->eeprom_read_len;
+    if(range->bytes_to_read % cmds_num != 0) {
+        return -1;
+    }
 
-	for(int i=0; i<mem_info->bytes_to_read; i++)
-	{
-		create_memory_cmd(read_pattern, read_pattern_len,
-				address, 0, cmd);
+    *crc = CRC32_INIT;
+    addr_left = range->bytes_to_read / cmds_num;
 
-		status = programmer_write_raw_cmd(cmd, res);
-		OSI_ASSERT_ON_ERROR(status);
+    while(addr_left > 0) {
+        _u32 n = CRC_CHUNK_SIZE / cmds_num;
 
-		buf[answer_counter++] = res[AVR_CMD_SIZE-1];
-		address++;
-	}
+        if(n > addr_left) {
+            n = addr_left;
+        }
 
-	return mem_info->bytes_to_read;
+        /* Chunk never crosses page boundary */
+        if(page_crcs != NULL && n > page_words - (address & (page_words - 1))) {
+            n = page_words - (address & (page_words - 1));
+        }
+
+        status = read_memory_cmds(read_cmds, cmds_num, (range->mem_t == MEMORY_FLASH),
+                                  address, n * cmds_num, buf);
+        OSI_ASSERT_ON_ERROR(status);
+
+        *crc = crc32_update(*crc, buf, n * cmds_num);
+
+        address += n;
+        addr_left -= n;
+
+        if(page_crcs == NULL) {
+            continue;
+        }
+
+        page_crc = crc32_update(page_crc, buf, n * cmds_num);
+
+        if((address & (page_words - 1)) == 0 || addr_left == 0) {
+            if(page < pages_num) {
+                page_crcs[page] = page_crc;
+            }
+
+            page++;
+            page_crc = CRC32_INIT;
+        }
+    }
+
+    return status;
+}
+
+
+/*
+ * ************************************************************
+ * Reads memory in batches. Every address produces cmds_num
+ * bytes, one per read command. Output bytes of the whole batch
+ * are extracted after single transfer.
+ *
+ * Flash batches do not cross 64K-word segments, so that segment
+ * is selected once before the batch.
+ * ************************************************************
+ */
+static _i16 read_memory_cmds(AvrCmdTemplate **read_cmds, _u8 cmds_num, _u8 flash,
+                             _u32 address, _u32 bytes_num, _u8 *buf)
+{
+    _i16 status = 0;
+    _u32 addr_num = bytes_num / cmds_num;
+    _u32 addr_per_batch = BATCH_MAX_CMDS / cmds_num;
+    _u32 n;
+
+    for(_u32 done=0; done<addr_num; done+=n) {
+        n = addr_num - done;
+
+        if(n > addr_per_batch) {
+            n = addr_per_batch;
+        }
+
+        if(flash) {
+            _u32 segment_end = ((address + done) | ((1UL << EXT_SEGMENT_SHIFT) - 1)) + 1;
+
+            if(n > segment_end - (address + done)) {
+                n = segment_end - (address + done);
+            }
+
+            status = select_ext_segment(address + done);
+            OSI_ASSERT_ON_ERROR(status);
+        }
+
+        for(_u32 i=0; i<n; i++) {
+            for(_u8 c=0; c<cmds_num; c++) {
+                status = batch_add(read_cmds[c], address + done + i, 0);
+                OSI_ASSERT_ON_ERROR(status);
+            }
+        }
+
+        status = batch_flush();
+        OSI_ASSERT_ON_ERROR(status);
+
+        for(_u32 i=0; i<n*cmds_num; i++) {
+            buf[done*cmds_num + i] = batch_rx[i*AVR_CMD_SIZE + AVR_CMD_SIZE - 1];
+        }
+    }
+
+    return status;
 }
 
 
@@ -357,31 +1229,95 @@ static _i16 _read_eeprom_memory(AvrReadMemData *mem_info, _u8 *buf)
 /**                 ADDITIONAL FUNCTIONS SECTION             **/
 /**************************************************************/
 
+/*
+ * ************************************************************
+ * Appends instruction to the batch. Full batch is flushed so
+ * answers of previous instructions are lost.
+ * ************************************************************
+ */
+static _i16 batch_add(AvrCmdTemplate *tmpl, _u32 addr, _u8 input) {
+    _i16 status = 0;
 
+    if(batch_len == sizeof batch_tx) {
+        status = batch_flush();
+        OSI_ASSERT_ON_ERROR(status);
+    }
 
-static inline void spi_enable(void) {
-    MAP_SPIEnable(PROG_SPI_BASE);
+    create_memory_cmd(tmpl, addr, input, batch_tx + batch_len);
+    batch_len += AVR_CMD_SIZE;
+
+    return status;
 }
 
 
-static inline void spi_disable(void) {
-    MAP_SPIDisable(PROG_SPI_BASE);
+/* Appends instruction which is not built from template */
+static _i16 batch_add_raw(const _u8 *cmd) {
+    _i16 status = 0;
+
+    if(batch_len == sizeof batch_tx) {
+        status = batch_flush();
+        OSI_ASSERT_ON_ERROR(status);
+    }
+
+    memcpy(batch_tx + batch_len, cmd, AVR_CMD_SIZE);
+    batch_len += AVR_CMD_SIZE;
+
+    return status;
 }
 
-static inline void configure_spi(unsigned long spi_rate) {
-    spi_disable();
 
-    MAP_SPIReset(PROG_SPI_BASE);
-    MAP_SPIConfigSetExpClk(PROG_SPI_BASE,
-                           MAP_PRCMPeripheralClockGet(PRCM_GSPI),
-                           spi_rate,
-                           SPI_MODE_MASTER,
-                           SPI_SUB_MODE_0,
-                           (SPI_SW_CTRL_CS |
-                            SPI_4PIN_MODE |
-                            SPI_TURBO_OFF |
-                            SPI_CS_ACTIVELOW |
-                            SPI_WL_8));
+/*
+ * ************************************************************
+ * Selects 64K-word flash segment for following reads and page
+ * writes. Load Extended Address is only sent when segment
+ * changes. It is transferred at once together with everything
+ * batched before, so answers of following instructions keep
+ * their positions in batch.
+ * ************************************************************
+ */
+static _i16 select_ext_segment(_u32 address) {
+    _i16 status;
+    _u32 segment = address >> EXT_SEGMENT_SHIFT;
+
+    if(!mcu_info->ext_addr_supported || segment == ext_segment) {
+        return 0;
+    }
+
+    status = batch_add(&mcu_info->load_ext_addr, address, 0);
+    OSI_ASSERT_ON_ERROR(status);
+
+    status = batch_flush();
+    OSI_ASSERT_ON_ERROR(status);
+
+    ext_segment = segment;
+
+    return status;
 }
 
 
+/*
+ * ************************************************************
+ * Transfers all batched instructions at once and checks echo
+ * of every instruction. Answers are left in batch_rx.
+ * ************************************************************
+ */
+static _i16 batch_flush(void) {
+    _i16 status;
+    _u16 len = batch_len;
+
+    batch_len = 0;
+
+    if(len == 0) {
+        return 0;
+    }
+
+    status = prog_spi_transfer(batch_tx, batch_rx, len);
+    OSI_ASSERT_ON_ERROR(status);
+
+    for(_u16 i=0; i<len; i+=AVR_CMD_SIZE) {
+        status = check_cmd_status(batch_tx + i, batch_rx + i);
+        OSI_ASSERT_ON_ERROR(status);
+    }
+
+    return status;
+}
@@ -8,11 +8,26 @@
 #include "programmer_parser.h"
 
 
-void programmer_set_mcu_info(AvrMcuInfo *info);
+void programmer_set_mcu_info(const AvrMcuInfo *info);
+const AvrMcuInfo* programmer_mcu_info(void);
+_i16 programmer_set_targets(_u8 mask);
+_u8  programmer_live_targets(void);
+_u8  programmer_failed_targets(void);
+void programmer_fail_target(_u8 target);
+_i16 programmer_select_target(_u8 target);
 _i16 programmer_enable_pgm_mode(void);
+_i16 programmer_match_signatures(const _u8 *signature);
+_i32 programmer_ramp_spi_rate(void);
+_i16 programmer_read_signature(_u8 *signature);
+_i16 programmer_read_fuses(AvrFuseData *data);
+_i16 programmer_write_fuses(_u8 mask, const _u8 *values, _u8 *failed_mask);
 _i16 programmer_write_cmd(AvrCommand *cmd, AvrCommand *answer);
 _i16 programmer_write_raw_cmd(_u8 *cmd, _u8 *answer);
 _i16 programmer_program_memory(AvrProgMemData *mem_data);
-_i16 programmer_read_memory(AvrReadMemData *mem_data, _u8 *buf);
+_i16 programmer_chip_erase(void);
+_i32 programmer_read_memory(AvrReadMemData *mem_data, _u8 *buf);
+_i16 programmer_flash_page_crcs(_u32 address, _u16 pages, _u32 *crcs);
+_i16 programmer_memory_crc(AvrReadMemData *range, _u32 *crc,
+                           _u32 *page_crcs, _u16 pages_num);
 
 #endif // PROGRAMMER_H_INCLUDED
@@ -4,4 +4,6 @@
 #define AVR_CMD_SIZE 	4
 #define AVR_WORD_SIZE	2
 
+#define MCU_SIGNATURE_SIZE	3
+
 #endif // PROGRAMMER_CONFIG_H_INCLUDED
@@ -3,6 +3,7 @@
 #include "protocol.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #define PROG_MEM_FIXED_SIZE     5
 #define READ_MEM_FIXED_SIZE     9
@@ -24,21 +25,28 @@ AvrMemoryType get_memory_type(_u8 byte)
 
 
 /**************************************************************
-TODO: speed up removing copies
+Data is not copied and points into packet so packet must
+outlive mem_data.
+
+Offset is the number of bytes preceding memory data fields.
 ***************************************************************/
-_i16 get_prog_mem_data(Packet *packet, AvrProgMemData *mem_data)
+_i16 get_prog_mem_data(Packet *packet, _u16 offset, AvrProgMemData *mem_data)
 {
-	_u8 *buf = packet->packet_data;
+	_u8 *buf = packet->packet_data + offset;
     _u32 len = packet->header.data_size;
 
+    if(len < offset + PROG_MEM_FIXED_SIZE) {
+        return -1;
+    }
+
+    len -= offset;
+
 	mem_data->start_address = (buf[0] << 24) | (buf[1] << 16)
 			| (buf[2] << 8) | (buf[3]);
 
 	mem_data->memory_type = get_memory_type(buf[4]);
 	mem_data->data_len = (len-PROG_MEM_FIXED_SIZE);
-	mem_data->data = (_u8*) malloc(sizeof(_u8) * mem_data->data_len);
-
-	memcpy(mem_data->data, buf+PROG_MEM_FIXED_SIZE, mem_data->data_len);
+	mem_data->data = buf + PROG_MEM_FIXED_SIZE;
 
 	return 0;
 }
@@ -62,8 +70,9 @@ _i16 get_read_mem_data(Packet *packet, AvrReadMemData *mem_data) {
 }
 
 
+/* Last byte of answer carries output of instruction so it is not an echo */
 _i16 check_cmd_status(_u8 *cmd, _u8 *answer) {
-    for(int i=1; i<AVR_CMD_SIZE; i++) {
+    for(int i=1; i<AVR_CMD_SIZE-1; i++) {
         if(answer[i] != cmd[i-1]) {
             return -1;
         }
@@ -73,133 +82,272 @@ _i16 check_cmd_status(_u8 *cmd, _u8 *answer) {
 }
 
 
-_i16 get_mcu_info(Packet *packet, AvrMcuInfo *mcu_data) {
-	_u8 *buf = packet->packet_data;
-	_u32 k = 0;
+/*
+ * ********************************************************************
+ * Compiles length prefixed pattern from buffer and moves offset past it.
+ * Pattern must lie within size bytes of buffer.
+ * ********************************************************************
+ */
+static _i16 read_template(_u8 *buf, _u32 size, _u32 *offset, AvrCmdTemplate *tmpl)
+{
+	_u32 k = *offset;
+	_u8 len;
 
-	mcu_data->flash_load_lo_len = buf[k++];
-	mcu_data->flash_load_lo_pattern = calloc(mcu_data->flash_load_lo_len + 1, sizeof(char));
+	if(k >= size)
+	{
+		return -1;
+	}
 
-	for(_u32 i=0; i<mcu_data->flash_load_lo_len; i++)
+	len = buf[k++];
+	if(k + len > size)
 	{
-		mcu_data->flash_load_lo_pattern[i] = buf[k++];
+		return -1;
 	}
-	mcu_data->flash_load_lo_pattern[k] = '\0';
 
-	mcu_data->flash_load_hi_len = buf[k++];
-	mcu_data->flash_load_hi_pattern = calloc(mcu_data->flash_load_hi_len + 1, sizeof(char));
+	*offset = k + len;
+	return compile_memory_cmd((char*)(buf + k), len, tmpl);
+}
+
 
-	for(_u32 i=0; i<mcu_data->flash_load_hi_len; i++)
+/* Copies n bytes if they lie within size bytes of buffer */
+static _i16 read_bytes(_u8 *buf, _u32 size, _u32 *offset, _u8 *dst, _u32 n)
+{
+	if(*offset + n > size)
 	{
-		mcu_data->flash_load_hi_pattern[i] = (char)buf[k++];
+		return -1;
 	}
-	mcu_data->flash_load_hi_pattern[k] = '\0';
 
-	mcu_data->flash_read_lo_len = buf[k++];
-	mcu_data->flash_read_lo_pattern = calloc(mcu_data->flash_read_lo_len + 1, sizeof(char));
+	memcpy(dst, buf + *offset, n);
+	*offset += n;
+
+	return 0;
+}
+
 
-	for(_u32 i=0; i<mcu_data->flash_read_lo_len; i++)
+_i16 get_mcu_info(Packet *packet, AvrMcuInfo *mcu_data) {
+	_u8 *buf = packet->packet_data;
+	_u32 size = packet->header.data_size;
+	_u32 k = 0;
+	_u8 word[2];
+
+	if(size > sizeof packet->packet_data)
 	{
-		mcu_data->flash_read_lo_pattern[i] = (char)buf[k++];
+		return -1;
 	}
-	mcu_data->flash_read_lo_pattern[k] = '\0';
-
 
-	mcu_data->flash_read_hi_len = buf[k++];
-	mcu_data->flash_read_hi_pattern = calloc(mcu_data->flash_read_hi_len + 1, sizeof(char));
+	if(read_template(buf, size, &k, &mcu_data->flash_load_lo) < 0 ||
+	   read_template(buf, size, &k, &mcu_data->flash_load_hi) < 0 ||
+	   read_template(buf, size, &k, &mcu_data->flash_read_lo) < 0 ||
+	   read_template(buf, size, &k, &mcu_data->flash_read_hi) < 0 ||
+	   read_bytes(buf, size, &k, &mcu_data->flash_wait_ms, 1) < 0)
+	{
+		return -1;
+	}
 
-	for(_u32 i=0; i<mcu_data->flash_read_hi_len; i++)
+	if(read_template(buf, size, &k, &mcu_data->eeprom_write) < 0 ||
+	   read_template(buf, size, &k, &mcu_data->eeprom_read) < 0 ||
+	   read_bytes(buf, size, &k, &mcu_data->eeprom_wait_ms, 1) < 0 ||
+	   read_bytes(buf, size, &k, mcu_data->pgm_enable, AVR_CMD_SIZE) < 0)
 	{
-		mcu_data->flash_read_hi_pattern[i] = buf[k++];
+		return -1;
 	}
-	mcu_data->flash_load_hi_pattern[k] = '\0';
 
-	mcu_data->flash_wait_ms = buf[k++];
+	if(read_bytes(buf, size, &k, word, sizeof word) < 0 ||
+	   read_template(buf, size, &k, &mcu_data->flash_write_page) < 0)
+	{
+		return -1;
+	}
+	mcu_data->flash_page_size = (word[0] << 8) | word[1];
 
+	/* Empty pattern means part has no RDY/BSY polling */
+	if(k >= size)
+	{
+		return -1;
+	}
+	mcu_data->rdy_bsy_supported = (buf[k] != 0);
+	if(read_template(buf, size, &k, &mcu_data->poll_rdy_bsy) < 0)
+	{
+		return -1;
+	}
 
-	mcu_data->eeprom_write_len = buf[k++];
-	mcu_data->eeprom_write_pattern = calloc(mcu_data->eeprom_write_len + 1, sizeof(char));
+	/* Target clock is optional. SPI rate is not raised without it. */
+	mcu_data->fck_khz = 0;
+	if(read_bytes(buf, size, &k, word, sizeof word) == 0)
+	{
+		mcu_data->fck_khz = (word[0] << 8) | word[1];
+	}
 
-	for(_u32 i=0; i<mcu_data->eeprom_write_len; i++)
+	/* Load Extended Address pattern is optional and follows clock */
+	mcu_data->ext_addr_supported = FALSE;
+	memset(&mcu_data->load_ext_addr, 0, sizeof mcu_data->load_ext_addr);
+	if(k < size)
 	{
-		mcu_data->eeprom_write_pattern[i] = buf[k++];
+		mcu_data->ext_addr_supported = (buf[k] != 0);
+		if(read_template(buf, size, &k, &mcu_data->load_ext_addr) < 0)
+		{
+			return -1;
+		}
 	}
-	mcu_data->eeprom_write_pattern[k] = '\0';
 
+	/* EEPROM page size and page patterns are optional and follow it */
+	mcu_data->eeprom_page_size = 0;
+	memset(&mcu_data->eeprom_load_page, 0, sizeof mcu_data->eeprom_load_page);
+	memset(&mcu_data->eeprom_write_page, 0, sizeof mcu_data->eeprom_write_page);
+	if(k < size)
+	{
+		if(read_bytes(buf, size, &k, &mcu_data->eeprom_page_size, 1) < 0 ||
+		   read_template(buf, size, &k, &mcu_data->eeprom_load_page) < 0 ||
+		   read_template(buf, size, &k, &mcu_data->eeprom_write_page) < 0)
+		{
+			return -1;
+		}
+	}
 
-	mcu_data->eeprom_read_len = buf[k++];
-	mcu_data->eeprom_read_pattern = calloc(mcu_data->eeprom_read_len + 1, sizeof(char));
+	/* Page engine relies on page size being power of two */
+	if((mcu_data->flash_page_size == 0) ||
+	   (mcu_data->flash_page_size & (mcu_data->flash_page_size - 1)) != 0)
+	{
+		return -1;
+	}
 
-	for (_u32 i=0; i<mcu_data->eeprom_read_len; i++)
+	if((mcu_data->eeprom_page_size & (mcu_data->eeprom_page_size - 1)) != 0)
 	{
-		mcu_data->eeprom_read_pattern[i] = buf[k++];
+		return -1;
 	}
-	mcu_data->eeprom_read_pattern[k] = '\0';
 
-	mcu_data->eeprom_wait_ms = buf[k++];
+	return 0;
+}
+
+
+/*
+ * ********************************************************************
+ * Appends bit to the list of runs. Bit is merged into the last run
+ * when both source and destination follow it.
+ * ********************************************************************
+ */
+static _i16 add_bit_run(AvrBitRun *runs, _u8 *runs_num, _u8 src, _u8 dst)
+{
+	if(*runs_num > 0)
+	{
+		AvrBitRun *last = &runs[*runs_num - 1];
+
+		if((last->src_shift == src + 1) && (last->dst_shift == dst + 1) &&
+		   (last->mask != 0xFFFF))
+		{
+			last->src_shift = src;
+			last->dst_shift = dst;
+			last->mask = (last->mask << 1) | 0x01;
 
-	for(_u32 i=0; i<AVR_CMD_SIZE; i++)
+			return 0;
+		}
+	}
+
+	if(*runs_num == AVR_CMD_MAX_RUNS)
 	{
-		mcu_data->pgm_enable[i] = buf[k++];
+		return -1;
 	}
 
+	runs[*runs_num].src_shift = src;
+	runs[*runs_num].dst_shift = dst;
+	runs[*runs_num].mask = 0x01;
+	(*runs_num)++;
+
 	return 0;
 }
 
+
 /*
  * ********************************************************************
- * Miss comparing with 'x' and 'o' as memory filled with zeroes
- * Works for load, write and read commands
+ * Compiles ASCII pattern into command template.
+ *
+ * Every token takes one bit of command starting from MSB:
+ *      '1'     --- constant one
+ *      'aN'    --- N-th bit of address
+ *      'i'     --- next bit of input starting from MSB
+ *      other   --- zero
  * ********************************************************************
  */
-void create_memory_cmd(char *pattern, _u8 pattern_len,
-                       _u32 addr, _u8 input, _u8 *cmd)
+_i16 compile_memory_cmd(const char *pattern, _u8 pattern_len,
+                        AvrCmdTemplate *tmpl)
 {
-	memset(cmd, 0, sizeof(_u8)*AVR_CMD_SIZE);
+	_i8 bit = AVR_CMD_SIZE*8 - 1;
+	_i8 input_bit = 7;
+	_i16 status = 0;
 
-	_u8 cmd_byte_offset = 0;
-	_i8 cmd_bit_offset = 7;
-	_u8 cmd_input_offset = 7;
+	memset(tmpl, 0, sizeof *tmpl);
 
-	for(_u8 j=0; j<pattern_len; j++)
+	for(_u8 j=0; j<pattern_len; j++, bit--)
 	{
-		if(pattern[j] == '1')
+		if(bit < 0)
 		{
-			cmd[cmd_byte_offset] |= (1 << cmd_bit_offset);
+			return -1;
 		}
-		else if(pattern[j] == '0')
+
+		if(pattern[j] == '1')
 		{
-			cmd[cmd_byte_offset] &= ~(0 << cmd_bit_offset);
+			tmpl->base |= (1UL << bit);
 		}
 		else if(pattern[j] == 'a')
 		{
-			j++;
-			_u8 k = 0;
-			char ch_address_shift[3];
+			_u8 address_shift = 0;
 
-			while((pattern[j] >= '0') && (pattern[j] <= '9'))
+			while((j+1 < pattern_len) && (pattern[j+1] >= '0') && (pattern[j+1] <= '9'))
 			{
-				ch_address_shift[k++] = pattern[j++];
+				address_shift = address_shift*10 + (pattern[++j] - '0');
 			}
-			/* last j++ plus j++ in cycle causes missing next char */
-			j--;
-			ch_address_shift[k] = '\0';
 
-			_u32 address_shift = atoi(ch_address_shift);
-			_u8 address_bit = (addr >> address_shift) & 0x01;
-			cmd[cmd_byte_offset] |= (address_bit << cmd_bit_offset);
+			if(address_shift >= 32)
+			{
+				return -1;
+			}
+
+			status = add_bit_run(tmpl->addr_runs, &tmpl->addr_runs_num, address_shift, bit);
 		}
 		else if(pattern[j] == 'i')
 		{
-			_u8 input_bit = (input >> cmd_input_offset) & 0x01;
-			cmd[cmd_byte_offset] |= (input_bit << cmd_bit_offset);
-			cmd_input_offset--;
+			if(input_bit < 0)
+			{
+				return -1;
+			}
+
+			status = add_bit_run(tmpl->input_runs, &tmpl->input_runs_num, input_bit--, bit);
 		}
 
-		if(--cmd_bit_offset < 0)
+		if(status < 0)
 		{
-			cmd_bit_offset = 7;
-			cmd_byte_offset += 1;
+			return status;
 		}
 	}
+
+	return 0;
+}
+
+
+/*
+ * ********************************************************************
+ * Scatters address and input bits into compiled command.
+ * Works for load, write and read commands
+ * ********************************************************************
+ */
+void create_memory_cmd(const AvrCmdTemplate *tmpl,
+                       _u32 addr, _u8 input, _u8 *cmd)
+{
+	_u32 word = tmpl->base;
+
+	for(_u8 i=0; i<tmpl->addr_runs_num; i++)
+	{
+		const AvrBitRun *run = &tmpl->addr_runs[i];
+		word |= ((addr >> run->src_shift) & run->mask) << run->dst_shift;
+	}
+
+	for(_u8 i=0; i<tmpl->input_runs_num; i++)
+	{
+		const AvrBitRun *run = &tmpl->input_runs[i];
+		word |= ((_u32)(input >> run->src_shift) & run->mask) << run->dst_shift;
+	}
+
+	cmd[0] = (word >> 24) & 0xFF;
+	cmd[1] = (word >> 16) & 0xFF;
+	cmd[2] = (word >> 8) & 0xFF;
+	cmd[3] = word & 0xFF;
 }
@@ -7,29 +7,63 @@
 #include "programmer_config.h"
 
 
+/* Maximum number of bit runs in compiled command */
+#define AVR_CMD_MAX_RUNS    8
+
+
+/* Contiguous run of bits copied from source value into command */
+typedef struct {
+    _u8     src_shift;
+    _u8     dst_shift;
+    _u16    mask;
+} AvrBitRun;
+
+
+/* Command pattern compiled once per MCU info load */
+typedef struct {
+    _u32        base;
+
+    _u8         addr_runs_num;
+    AvrBitRun   addr_runs[AVR_CMD_MAX_RUNS];
+
+    _u8         input_runs_num;
+    AvrBitRun   input_runs[AVR_CMD_MAX_RUNS];
+} AvrCmdTemplate;
+
+
 typedef struct {
-	_u8 	flash_load_hi_len;
-	char 		*flash_load_hi_pattern;
+	AvrCmdTemplate  flash_load_hi;
+	AvrCmdTemplate  flash_load_lo;
+	AvrCmdTemplate  flash_read_lo;
+	AvrCmdTemplate  flash_read_hi;
+	AvrCmdTemplate  flash_write_page;
 
-	_u8		flash_load_lo_len;
-	char		*flash_load_lo_pattern;
+	_u8             flash_wait_ms;
 
-	_u8		flash_read_lo_len;
-	char		*flash_read_lo_pattern;
+	/* Flash page size in words */
+	_u16            flash_page_size;
 
-	_u8		flash_read_hi_len;
-	char		*flash_read_hi_pattern;
+	AvrCmdTemplate  eeprom_write;
+	AvrCmdTemplate  eeprom_read;
 
-	_u8		flash_wait_ms;
+	_u8             eeprom_wait_ms;
+	_u8             pgm_enable[AVR_CMD_SIZE];
 
-	_u8		eeprom_write_len;
-	char		*eeprom_write_pattern;
+	/* Poll RDY/BSY instruction. Not all parts support it */
+	_u8             rdy_bsy_supported;
+	AvrCmdTemplate  poll_rdy_bsy;
 
-	_u8 	eeprom_read_len;
-	char		*eeprom_read_pattern;
+	/* Target clock in kHz limiting SPI rate. Zero if unknown */
+	_u16            fck_khz;
 
-	_u8		eeprom_wait_ms;
-	_u8		pgm_enable[AVR_CMD_SIZE];
+	/* Load Extended Address for flash above 64K words */
+	_u8             ext_addr_supported;
+	AvrCmdTemplate  load_ext_addr;
+
+	/* EEPROM page size in bytes. Zero if part writes byte by byte */
+	_u8             eeprom_page_size;
+	AvrCmdTemplate  eeprom_load_page;
+	AvrCmdTemplate  eeprom_write_page;
 } AvrMcuInfo;
 
 
@@ -53,7 +87,7 @@ typedef struct {
 
 	_u32 		    start_address;
 	AvrMemoryType	memory_type;
-	_u8 		    data_len;
+	_u16 		    data_len;
 	_u8 		    *data;
 
 } AvrProgMemData;
@@ -66,12 +100,33 @@ typedef struct {
 } AvrCommand;
 
 
+/* Lock and fuse bytes. Order is the one of write mask bits. */
+typedef enum {
+    AVR_FUSE_LOCK = 0,
+    AVR_FUSE_LOW,
+    AVR_FUSE_HIGH,
+    AVR_FUSE_EXT,
+    AVR_FUSES_NUM
+} AvrFuse;
+
+
+typedef struct {
+
+    _u8 signature[MCU_SIGNATURE_SIZE];
+    _u8 calibration;
+    _u8 fuses[AVR_FUSES_NUM];
+
+} AvrFuseData;
+
+
 AvrMemoryType   get_memory_type(_u8 byte);
-_i16            get_prog_mem_data(Packet *packet, AvrProgMemData *mem_data);
+_i16            get_prog_mem_data(Packet *packet, _u16 offset, AvrProgMemData *mem_data);
 _i16            get_read_mem_data(Packet *packet, AvrReadMemData *mem_data);
 _i16            get_mcu_info(Packet *packet, AvrMcuInfo *mcu_data);
 _i16            check_cmd_status(_u8 *cmd, _u8 *answer);
-void            create_memory_cmd(char *pattern, _u8 pattern_len,
+_i16            compile_memory_cmd(const char *pattern, _u8 pattern_len,
+                                   AvrCmdTemplate *tmpl);
+void            create_memory_cmd(const AvrCmdTemplate *tmpl,
                                   _u32 addr, _u8 input, _u8 *cmd);
 
 
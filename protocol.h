@@ -27,10 +27,144 @@
 #define PL_READ_MEMORY                 0x22
 #define PL_MEMORY                      0x23
 #define PL_CMD                         0x24
+#define PL_PROGRAM_WINDOW              0x25
+#define PL_PROGRAM_ACK                 0x26
+#define PL_IMAGE_BEGIN                 0x27
+#define PL_IMAGE_DATA                  0x28
+#define PL_PROGRAM_IMAGE               0x29
+#define PL_CHIP_ERASE                  0x2A
+#define PL_PAGE_CRC_REQUEST            0x2B
+#define PL_PAGE_CRC                    0x2C
+#define PL_SELECT_PART                 0x2D
+#define PL_VERIFY                      0x2E
+#define PL_FUSES                       0x2F
+
+/*
+ * Programmer packets continue at 0x60. Group is told by mask bits
+ * so these go to programmer like the ones above.
+ */
+#define PL_PROGRAM_HEX                 0x60
 
 #define PL_FLASH_MEMORY_BYTE           0x00
 #define PL_EEPROM_MEMORY_BYTE          0x01
 
+/* Memory packet. Read is streamed as numbered chunks */
+#define PL_MEMORY_SEQ_OFFSET           0
+#define PL_MEMORY_SEQ_SIZE             2
+#define PL_MEMORY_DATA_OFFSET          (PL_MEMORY_SEQ_OFFSET + PL_MEMORY_SEQ_SIZE)
+#define PL_MEMORY_CHUNK_SIZE           1020
+
+/* Program window packet. Zero window turns windowed stream off */
+#define PL_PROGRAM_WINDOW_OFFSET       0
+
+/* Program memory packets of windowed stream start with sequence number */
+#define PL_PROGRAM_SEQ_OFFSET          0
+#define PL_PROGRAM_SEQ_SIZE            2
+
+/* Program ACK packet. Sequence is the next one expected by device */
+#define PL_PROGRAM_ACK_STATUS_OFFSET   0
+#define PL_PROGRAM_ACK_SEQ_OFFSET      1
+#define PL_PROGRAM_ACK_SIZE            3
+
+/* Image begin packet. Image is staged in serial flash before programming */
+#define PL_IMAGE_MEMORY_OFFSET         0
+#define PL_IMAGE_ADDRESS_OFFSET        1
+#define PL_IMAGE_LENGTH_OFFSET         5
+#define PL_IMAGE_CRC_OFFSET            9
+#define PL_IMAGE_BEGIN_SIZE            13
+
+/* Image data packet. Chunks are written one after another */
+#define PL_IMAGE_DATA_OFFSET_OFFSET    0
+#define PL_IMAGE_DATA_OFFSET_SIZE      4
+
+/* Page CRC request. Address is a word address of the first flash page */
+#define PL_PAGE_CRC_ADDRESS_OFFSET     0
+#define PL_PAGE_CRC_COUNT_OFFSET       4
+#define PL_PAGE_CRC_REQUEST_SIZE       6
+
+/* Page CRC packet repeats request and is followed by CRC32 of every page */
+#define PL_PAGE_CRC_DATA_OFFSET        PL_PAGE_CRC_REQUEST_SIZE
+#define PL_PAGE_CRC_MAX_PAGES          ((PL_PACKET_DATA_SIZE - PL_PAGE_CRC_DATA_OFFSET) / 4)
+
+/* Programmer init may carry mask of gang targets. Target 0 by default. */
+#define PL_PROG_INIT_TARGETS_OFFSET    0
+#define PL_PROG_INIT_TARGETS_SIZE      1
+
+/*
+ * ACK of programmer init. Host loads MCU info only on cache miss.
+ * Failed is a mask of gang targets which have not entered PGM mode
+ * or whose signature differs.
+ */
+#define PL_PROG_INIT_HIT_OFFSET        0
+#define PL_PROG_INIT_SIGN_OFFSET       1
+#define PL_PROG_INIT_RATE_OFFSET       4
+#define PL_PROG_INIT_FAILED_OFFSET     8
+#define PL_PROG_INIT_ACK_SIZE          9
+
+/*
+ * Select part packet. Target clock in kHz is optional, but part table
+ * does not know it, so SPI rate is only raised when it is sent.
+ */
+#define PL_SELECT_PART_SIGN_OFFSET     0
+#define PL_SELECT_PART_SIGN_SIZE       3
+#define PL_SELECT_PART_FCK_OFFSET      3
+
+/*
+ * Verify packet. Expected CRC32 of flash pages touched by range may
+ * follow, so that the first mismatching page can be found.
+ */
+#define PL_VERIFY_MEMORY_OFFSET        0
+#define PL_VERIFY_ADDRESS_OFFSET       1
+#define PL_VERIFY_LENGTH_OFFSET        5
+#define PL_VERIFY_CRC_OFFSET           9
+#define PL_VERIFY_PAGES_OFFSET         13
+
+/*
+ * ACK of verify. Page is counted from the first page of range.
+ * CRC and page are of the first mismatching gang target, failed
+ * is a mask of all targets dropped so far.
+ */
+#define PL_VERIFY_ACK_CRC_OFFSET       0
+#define PL_VERIFY_ACK_PAGE_OFFSET      4
+#define PL_VERIFY_ACK_FAILED_OFFSET    8
+#define PL_VERIFY_ACK_SIZE             9
+#define PL_VERIFY_PAGE_UNKNOWN         0xFFFFFFFF
+
+/*
+ * Fuses packet. Empty one only reads. Otherwise bytes selected by
+ * write mask are written, lock first, and read back.
+ */
+#define PL_FUSES_MASK_OFFSET           0
+#define PL_FUSES_VALUES_OFFSET         1
+#define PL_FUSES_WRITE_SIZE            5
+
+#define PL_FUSE_LOCK_BIT               0x01
+#define PL_FUSE_LOW_BIT                0x02
+#define PL_FUSE_HIGH_BIT               0x04
+#define PL_FUSE_EXT_BIT                0x08
+
+/* ACK of fuses. Values are in write mask order, failed is a mask. */
+#define PL_FUSES_ACK_SIGN_OFFSET       0
+#define PL_FUSES_ACK_CAL_OFFSET        3
+#define PL_FUSES_ACK_VALUES_OFFSET     4
+#define PL_FUSES_ACK_FAILED_OFFSET     8
+#define PL_FUSES_ACK_SIZE              9
+
+/*
+ * Program HEX packet carries next piece of Intel HEX text. Records
+ * may be split between packets. Stream ends with end of file record,
+ * which ACK reports once all data is programmed.
+ */
+#define PL_HEX_MEMORY_OFFSET           0
+#define PL_HEX_TEXT_OFFSET             1
+
+#define PL_HEX_ACK_EOF_OFFSET          0
+#define PL_HEX_ACK_SIZE                1
+
+/* ACK of load MCU info and select part carries SPI rate */
+#define PL_LOAD_MCU_RATE_OFFSET        0
+#define PL_LOAD_MCU_ACK_SIZE           4
+
 /* UART PACKETS */
 #define PL_UART_CONFIGURATION          0x30
 #define PL_UART_DATA                   0x31
@@ -50,7 +184,7 @@
 #define PL_PACKET_HEADER_SIZE		(PL_SIZE_FIELD_SIZE + PL_TYPE_FIELD_SIZE + PL_FLAGS_FIELD_SIZE + 1)
 #define PL_PACKET_RESERVED_BYTES	(PL_SIZE_FIELD_SIZE + PL_TYPE_FIELD_SIZE + PL_FLAGS_FIELD_SIZE + 1)
 
-/* Flags byte */
+/* Flags byte. Compressed memory data of ProgramMemory is one LZ4 block. */
 #define PL_FLAG_COMPRESSION_BIT     0
 #define PL_FLAG_ENCRYPTION_BIT      1
 #define PL_FLAG_SIGN_BIT            2
@@ -58,10 +192,14 @@
 /* Maximum data field length of packet */
 #define PL_MAX_DATA_LENGTH	        1029
 
+/* Data field which firmware packet buffer holds */
+#define PL_PACKET_DATA_SIZE         1024
+
 /* ACK packet */
 #define PL_ACK_BYTE_OFFSET          0
 #define PL_ACK_SUCCESS              1
 #define PL_ACK_FAILURE              0
+#define PL_ACK_MAX_DATA_SIZE        16
 
 /* Reset packet */
 #define PL_RESET_BYTE_OFFSET	    0
@@ -11,6 +11,8 @@
 #include "gpio.h"
 #include "gpio_if.h"
 
+#include "config.h"
+
 
 typedef struct _queue_ptr_wrapper {
     void *ptr;
@@ -56,10 +58,56 @@ _i16 sys_queue_write_ptr(OsiMsgQ_t *queue, void *ptr, OsiTime_t timeout) {
 }
 
 
+static const _u8 gang_reset_gpios[GANG_MAX_TARGETS] = GANG_RESET_GPIOS;
+static const _u8 gang_select_gpios[GANG_MAX_TARGETS] = GANG_SELECT_GPIOS;
+
+static void set_gpio(_u8 gpio_num, _u8 value);
+
+
 /*********************************************************
     Pulls connected MCU reset line down if status is 1
     otherwise pulls it up
 **********************************************************/
 void sys_reset_mcu(_u8 status) {
-    GPIO_IF_Set(6, GPIOA0_BASE, GPIO_PIN_6, status);
+    sys_reset_target(0, status);
+}
+
+
+/* Same as sys_reset_mcu() for gang target */
+void sys_reset_target(_u8 target, _u8 status) {
+    if(target < GANG_MAX_TARGETS) {
+        set_gpio(gang_reset_gpios[target], status);
+    }
+}
+
+
+/*********************************************************
+    Reset lines boot low, so every gang target is held in
+    reset and has its MISO connected. Releases all of them.
+**********************************************************/
+void sys_release_targets(void) {
+    for(_u8 t=0; t<GANG_MAX_TARGETS; t++) {
+        sys_reset_target(t, MCU_RESET_OFF);
+        sys_select_target(t, MCU_SELECT_OFF);
+    }
+}
+
+
+/*********************************************************
+    Connects MISO of gang target to programmer SPI.
+    Only one target may be selected at a time.
+**********************************************************/
+void sys_select_target(_u8 target, _u8 status) {
+    if(target < GANG_MAX_TARGETS) {
+        set_gpio(gang_select_gpios[target], status);
+    }
+}
+
+
+static void set_gpio(_u8 gpio_num, _u8 value) {
+    unsigned int port;
+    unsigned char pin;
+
+    GPIO_IF_GetPortNPin(gpio_num, &port, &pin);
+    GPIO_IF_Set(gpio_num, port, pin, value);
 }
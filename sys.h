@@ -20,6 +20,13 @@ _i16 sys_queue_write_ptr(OsiMsgQ_t *queue, void *ptr, OsiTime_t timeout);
 #define MCU_RESET_ON    0
 #define MCU_RESET_OFF   1
 
+/* MISO buffer enable is active low */
+#define MCU_SELECT_ON   0
+#define MCU_SELECT_OFF  1
+
 void sys_reset_mcu(_u8 status);
+void sys_reset_target(_u8 target, _u8 status);
+void sys_select_target(_u8 target, _u8 status);
+void sys_release_targets(void);
 
 #endif // SYS_H_INCLUDED
@@ -0,0 +1,388 @@
+#include "avr_sim.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "prog_spi.h"
+#include "sys.h"
+#include "config.h"
+
+
+#define SIM_EEPROM_PAGE_MAX     8
+#define SIM_CALIBRATION         0x9A
+#define SIM_CHIP_ERASE_MS       9
+#define SIM_FUSE_WRITE_US       4500
+
+/* Answer of target which does not drive MISO */
+#define SIM_MISO_FLOATING       0xFF
+
+
+typedef struct {
+    _u8                 connected;
+    _u8                 in_reset;
+    _u8                 pgm_enabled;
+    unsigned long long  busy_until_ns;
+
+    _u8                 *flash;
+    _u8                 *page_buf;
+    _u8                 ext_addr;
+
+    _u8                 *eeprom;
+    _u8                 eeprom_page_buf[SIM_EEPROM_PAGE_MAX];
+    _u8                 eeprom_page_loaded[SIM_EEPROM_PAGE_MAX];
+
+    _u8                 lock;
+    _u8                 fuse_low;
+    _u8                 fuse_high;
+    _u8                 fuse_ext;
+} SimTarget;
+
+
+static const AvrPart    *sim_part;
+static _u32             sim_fck_hz;
+static _u32             spi_rate;
+static _u8              targets_num;
+static _i8              selected = -1;
+static SimTarget        targets[GANG_MAX_TARGETS];
+static AvrSimStats      stats;
+
+
+static _u8 execute(SimTarget *target, const _u8 *cmd);
+static void start_write(SimTarget *target, _u32 time_us);
+static _u8 is_busy(const SimTarget *target);
+static _u32 flash_page_bytes(void);
+
+
+void avr_sim_init(const AvrPart *part, _u32 fck_hz, _u8 num) {
+    avr_sim_free();
+
+    sim_part = part;
+    sim_fck_hz = fck_hz;
+    targets_num = (num > GANG_MAX_TARGETS) ? GANG_MAX_TARGETS : num;
+    spi_rate = PROG_SPI_DEFAULT_FREQ;
+    selected = -1;
+
+    for(_u8 t=0; t<targets_num; t++) {
+        SimTarget *target = &targets[t];
+
+        memset(target, 0, sizeof *target);
+        target->connected = TRUE;
+        /* Reset lines boot low */
+        target->in_reset = TRUE;
+        target->flash = malloc(part->flash_size);
+        target->page_buf = malloc(flash_page_bytes());
+        target->eeprom = malloc(part->eeprom_size);
+
+        memset(target->flash, 0xFF, part->flash_size);
+        memset(target->page_buf, 0xFF, flash_page_bytes());
+        memset(target->eeprom, 0xFF, part->eeprom_size);
+
+        target->lock = 0xFF;
+        target->fuse_low = 0x62;
+        target->fuse_high = 0xD9;
+        target->fuse_ext = 0xFF;
+    }
+
+    avr_sim_reset_stats();
+}
+
+
+void avr_sim_free(void) {
+    for(_u8 t=0; t<targets_num; t++) {
+        free(targets[t].flash);
+        free(targets[t].page_buf);
+        free(targets[t].eeprom);
+    }
+
+    targets_num = 0;
+}
+
+
+void avr_sim_reset_stats(void) {
+    unsigned long long now = stats.time_ns;
+
+    memset(&stats, 0, sizeof stats);
+    stats.time_ns = now;
+}
+
+
+const AvrSimStats* avr_sim_stats(void) {
+    return &stats;
+}
+
+
+_u8* avr_sim_flash(_u8 target) {
+    return targets[target].flash;
+}
+
+
+_u8* avr_sim_eeprom(_u8 target) {
+    return targets[target].eeprom;
+}
+
+
+void avr_sim_disconnect(_u8 target) {
+    targets[target].connected = FALSE;
+}
+
+
+
+/************************** SPI BACKEND ****************************/
+void prog_spi_init(void) {
+}
+
+
+void prog_spi_configure(_u32 rate) {
+    spi_rate = rate;
+}
+
+
+void prog_spi_enable(void) {
+}
+
+
+void prog_spi_disable(void) {
+}
+
+
+/*
+ * Every target held in reset gets every instruction. Answer comes
+ * from selected one. Above fck/4 target samples wrong bits.
+ */
+_i16 prog_spi_transfer(_u8 *tx, _u8 *rx, _u16 len) {
+    unsigned long long cmd_ns = 8ULL * AVR_CMD_SIZE * 1000000000ULL / spi_rate;
+    _u8 too_fast = (spi_rate > sim_fck_hz / 4);
+
+    stats.transfers++;
+    stats.time_ns += AVR_SIM_TRANSFER_SETUP_NS;
+
+    memset(rx, SIM_MISO_FLOATING, len);
+
+    for(_u16 i=0; i + AVR_CMD_SIZE <= len; i += AVR_CMD_SIZE) {
+        stats.time_ns += cmd_ns;
+        stats.instructions++;
+
+        for(_u8 t=0; t<targets_num; t++) {
+            SimTarget *target = &targets[t];
+            _u8 out;
+
+            if(!target->connected || !target->in_reset) {
+                continue;
+            }
+
+            out = execute(target, tx + i);
+
+            /* Out of sync target leaves MISO floating */
+            if(t == selected && target->pgm_enabled) {
+                rx[i+1] = tx[i];
+                rx[i+2] = tx[i+1];
+                rx[i+3] = out;
+            }
+        }
+
+        if(too_fast) {
+            for(_u8 k=0; k<AVR_CMD_SIZE; k++) {
+                rx[i+k] = (rx[i+k] >> 1) | 0x80;
+            }
+        }
+    }
+
+    stats.time_ns += (len % AVR_CMD_SIZE) * 8ULL * 1000000000ULL / spi_rate;
+
+    return 0;
+}
+
+
+void sys_reset_target(_u8 t, _u8 status) {
+    if(t < targets_num) {
+        targets[t].in_reset = (status == MCU_RESET_ON);
+        targets[t].pgm_enabled = FALSE;
+    }
+}
+
+
+void sys_select_target(_u8 t, _u8 status) {
+    if(status == MCU_SELECT_ON) {
+        selected = t;
+    }
+    else if(selected == t) {
+        selected = -1;
+    }
+}
+
+
+void osi_Sleep(unsigned int ms) {
+    stats.time_ns += ms * 1000000ULL;
+}
+
+
+
+/************************ INSTRUCTION SET **************************/
+static _u8 execute(SimTarget *target, const _u8 *cmd) {
+    _u32 addr = (cmd[1] << 8) | cmd[2];
+    _u32 page_words = sim_part->info.flash_page_size;
+    _u32 eeprom_page = sim_part->info.eeprom_page_size;
+    _u32 word;
+
+    if(!target->pgm_enabled) {
+        if(cmd[0] == 0xAC && cmd[1] == 0x53) {
+            target->pgm_enabled = TRUE;
+        }
+
+        return 0x00;
+    }
+
+    /* Poll RDY/BSY is the only instruction allowed during write */
+    if(cmd[0] == 0xF0 && sim_part->info.rdy_bsy_supported) {
+        return is_busy(target);
+    }
+
+    if(is_busy(target)) {
+        /* Data polling reads 0xFF till write is over */
+        if(cmd[0] == 0x20 || cmd[0] == 0x28 || cmd[0] == 0xA0) {
+            return 0xFF;
+        }
+
+        stats.busy_violations++;
+        return 0x00;
+    }
+
+    switch(cmd[0]) {
+
+        case 0xAC:
+            switch(cmd[1]) {
+                case 0x53:
+                    return 0x00;
+
+                case 0x80:
+                    memset(target->flash, 0xFF, sim_part->flash_size);
+                    memset(target->eeprom, 0xFF, sim_part->eeprom_size);
+                    target->lock = 0xFF;
+                    start_write(target, SIM_CHIP_ERASE_MS * 1000);
+                    return 0x00;
+
+                /* Unimplemented bits stay 1 */
+                case 0xE0:
+                    target->lock &= cmd[3] | ~sim_part->fuse_bits[AVR_FUSE_LOCK];
+                    start_write(target, SIM_FUSE_WRITE_US);
+                    return 0x00;
+
+                case 0xA0:
+                    target->fuse_low = cmd[3];
+                    start_write(target, SIM_FUSE_WRITE_US);
+                    return 0x00;
+
+                case 0xA8:
+                    target->fuse_high = cmd[3];
+                    start_write(target, SIM_FUSE_WRITE_US);
+                    return 0x00;
+
+                case 0xA4:
+                    target->fuse_ext = cmd[3] | ~sim_part->fuse_bits[AVR_FUSE_EXT];
+                    start_write(target, SIM_FUSE_WRITE_US);
+                    return 0x00;
+            }
+            break;
+
+        case 0x30:
+            return (cmd[2] & 0x03) < MCU_SIGNATURE_SIZE ? sim_part->signature[cmd[2] & 0x03] : 0xFF;
+
+        case 0x38:
+            return SIM_CALIBRATION;
+
+        case 0x58:
+            return (cmd[1] == 0x08) ? target->fuse_high : target->lock;
+
+        case 0x50:
+            return (cmd[1] == 0x08) ? target->fuse_ext : target->fuse_low;
+
+        case 0x4D:
+            target->ext_addr = cmd[2];
+            return 0x00;
+
+        /* Flash page buffer is addressed by word inside of page */
+        case 0x40:
+        case 0x48:
+            word = addr & (page_words - 1);
+            target->page_buf[word * AVR_WORD_SIZE + (cmd[0] == 0x48)] = cmd[3];
+            return 0x00;
+
+        /* Write only clears bits, buffer is blank again afterwards */
+        case 0x4C:
+            word = (((_u32)target->ext_addr << 16) | addr) & ~(page_words - 1);
+            if(word * AVR_WORD_SIZE < sim_part->flash_size) {
+                _u8 *page = target->flash + word * AVR_WORD_SIZE;
+
+                for(_u32 i=0; i<flash_page_bytes(); i++) {
+                    page[i] &= target->page_buf[i];
+                }
+            }
+
+            memset(target->page_buf, 0xFF, flash_page_bytes());
+            stats.flash_page_writes++;
+            start_write(target, sim_part->info.flash_wait_ms * 1000 * AVR_SIM_BUSY_PERCENT / 100);
+            return 0x00;
+
+        case 0x20:
+        case 0x28:
+            word = ((_u32)target->ext_addr << 16) | addr;
+            if(word * AVR_WORD_SIZE >= sim_part->flash_size) {
+                return 0xFF;
+            }
+
+            return target->flash[word * AVR_WORD_SIZE + (cmd[0] == 0x28)];
+
+        case 0xC0:
+            target->eeprom[addr & (sim_part->eeprom_size - 1)] = cmd[3];
+            stats.eeprom_writes++;
+            start_write(target, sim_part->info.eeprom_wait_ms * 1000 * AVR_SIM_BUSY_PERCENT / 100);
+            return 0x00;
+
+        case 0xA0:
+            return target->eeprom[addr & (sim_part->eeprom_size - 1)];
+
+        case 0xC1:
+            if(eeprom_page == 0) {
+                break;
+            }
+
+            target->eeprom_page_buf[addr & (eeprom_page - 1)] = cmd[3];
+            target->eeprom_page_loaded[addr & (eeprom_page - 1)] = TRUE;
+            return 0x00;
+
+        /* Only loaded bytes of EEPROM page are written */
+        case 0xC2:
+            if(eeprom_page == 0) {
+                break;
+            }
+
+            addr &= (sim_part->eeprom_size - 1) & ~(eeprom_page - 1);
+            for(_u32 i=0; i<eeprom_page; i++) {
+                if(target->eeprom_page_loaded[i]) {
+                    target->eeprom[addr + i] = target->eeprom_page_buf[i];
+                }
+            }
+
+            memset(target->eeprom_page_loaded, 0, sizeof target->eeprom_page_loaded);
+            stats.eeprom_writes++;
+            start_write(target, sim_part->info.eeprom_wait_ms * 1000 * AVR_SIM_BUSY_PERCENT / 100);
+            return 0x00;
+    }
+
+    return 0x00;
+}
+
+
+static void start_write(SimTarget *target, _u32 time_us) {
+    target->busy_until_ns = stats.time_ns + time_us * 1000ULL;
+}
+
+
+static _u8 is_busy(const SimTarget *target) {
+    return stats.time_ns < target->busy_until_ns;
+}
+
+
+static _u32 flash_page_bytes(void) {
+    return (_u32)sim_part->info.flash_page_size * AVR_WORD_SIZE;
+}
@@ -0,0 +1,50 @@
+#ifndef AVR_SIM_H_INCLUDED
+#define AVR_SIM_H_INCLUDED
+
+/*
+ * Simulated AVR targets behind prog_spi.h and reset/select lines of
+ * sys.h, so programmer.c runs on host unchanged. Serial programming
+ * instructions are decoded from datasheet encodings, not from MCU
+ * info, so wrong templates show up as wrong memory contents.
+ *
+ * Time is simulated: SPI transfers take bits/rate plus per-transfer
+ * setup, writes keep target busy, osi_Sleep() advances the clock.
+ */
+
+#include "simplelink.h"
+
+#include "avr_parts.h"
+
+
+/* Time of CS assertion, DMA setup and interrupt per transfer */
+#define AVR_SIM_TRANSFER_SETUP_NS   15000ULL
+
+/* Real write takes this part of worst-case time from part table */
+#define AVR_SIM_BUSY_PERCENT        90
+
+
+typedef struct {
+    unsigned long long  time_ns;
+    _u32                transfers;
+    _u32                instructions;
+    _u32                flash_page_writes;
+    _u32                eeprom_writes;
+
+    /* Instructions which came while target was busy and were lost */
+    _u32                busy_violations;
+} AvrSimStats;
+
+
+void avr_sim_init(const AvrPart *part, _u32 fck_hz, _u8 targets_num);
+void avr_sim_free(void);
+void avr_sim_reset_stats(void);
+const AvrSimStats* avr_sim_stats(void);
+
+_u8* avr_sim_flash(_u8 target);
+_u8* avr_sim_eeprom(_u8 target);
+
+/* Target stops answering, e.g. to check gang programming */
+void avr_sim_disconnect(_u8 target);
+
+
+#endif // AVR_SIM_H_INCLUDED
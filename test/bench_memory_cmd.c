@@ -0,0 +1,158 @@
+/*
+ * Compares legacy ASCII pattern walker with compiled command templates.
+ *
+ * Build and run on host:
+ *      make -C test bench_memory_cmd && ./test/bench_memory_cmd
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "programmer_parser.h"
+
+
+#define BENCH_ITERATIONS    2000000
+#define VERIFY_ADDRESSES    0x10000
+
+
+typedef struct {
+    const char  *name;
+    const char  *pattern;
+} BenchPattern;
+
+
+/* ATmega328P serial programming instructions */
+static const BenchPattern patterns[] = {
+    {"flash load lo",   "01000000" "000xxxxx" "xxa5a4a3a2a1a0" "iiiiiiii"},
+    {"flash load hi",   "01001000" "000xxxxx" "xxa5a4a3a2a1a0" "iiiiiiii"},
+    {"flash read lo",   "00100000" "00a13a12a11a10a9a8" "a7a6a5a4a3a2a1a0" "oooooooo"},
+    {"flash read hi",   "00101000" "00a13a12a11a10a9a8" "a7a6a5a4a3a2a1a0" "oooooooo"},
+    {"flash write page","01001100" "00a13a12a11a10a9a8" "a7a6xxxxxx" "xxxxxxxx"},
+    {"eeprom write",    "11000000" "000xxxa9a8" "a7a6a5a4a3a2a1a0" "iiiiiiii"},
+    {"eeprom read",     "10100000" "000xxxa9a8" "a7a6a5a4a3a2a1a0" "oooooooo"},
+};
+
+#define PATTERNS_NUM    (sizeof(patterns)/sizeof(patterns[0]))
+
+
+/* Command builder as it was before templates were introduced */
+static void legacy_create_memory_cmd(char *pattern, _u8 pattern_len,
+                                     _u32 addr, _u8 input, _u8 *cmd)
+{
+	memset(cmd, 0, sizeof(_u8)*AVR_CMD_SIZE);
+
+	_u8 cmd_byte_offset = 0;
+	_i8 cmd_bit_offset = 7;
+	_u8 cmd_input_offset = 7;
+
+	for(_u8 j=0; j<pattern_len; j++)
+	{
+		if(pattern[j] == '1')
+		{
+			cmd[cmd_byte_offset] |= (1 << cmd_bit_offset);
+		}
+		else if(pattern[j] == '0')
+		{
+			cmd[cmd_byte_offset] &= ~(0 << cmd_bit_offset);
+		}
+		else if(pattern[j] == 'a')
+		{
+			j++;
+			_u8 k = 0;
+			char ch_address_shift[3];
+
+			while((pattern[j] >= '0') && (pattern[j] <= '9'))
+			{
+				ch_address_shift[k++] = pattern[j++];
+			}
+			j--;
+			ch_address_shift[k] = '\0';
+
+			_u32 address_shift = atoi(ch_address_shift);
+			_u8 address_bit = (addr >> address_shift) & 0x01;
+			cmd[cmd_byte_offset] |= (address_bit << cmd_bit_offset);
+		}
+		else if(pattern[j] == 'i')
+		{
+			_u8 input_bit = (input >> cmd_input_offset) & 0x01;
+			cmd[cmd_byte_offset] |= (input_bit << cmd_bit_offset);
+			cmd_input_offset--;
+		}
+
+		if(--cmd_bit_offset < 0)
+		{
+			cmd_bit_offset = 7;
+			cmd_byte_offset += 1;
+		}
+	}
+}
+
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+
+int main(void) {
+    AvrCmdTemplate tmpl[PATTERNS_NUM];
+    _u8 legacy[AVR_CMD_SIZE];
+    _u8 compiled[AVR_CMD_SIZE];
+    volatile _u8 sink = 0;
+    int failed = 0;
+
+    for(_u32 p=0; p<PATTERNS_NUM; p++) {
+        if(compile_memory_cmd(patterns[p].pattern, strlen(patterns[p].pattern), &tmpl[p]) < 0) {
+            printf("Failed to compile %s\n", patterns[p].name);
+            return 1;
+        }
+    }
+
+    /* Both builders have to produce identical commands */
+    for(_u32 p=0; p<PATTERNS_NUM; p++) {
+        for(_u32 addr=0; addr<VERIFY_ADDRESSES; addr++) {
+            _u8 input = (addr * 7) & 0xFF;
+
+            legacy_create_memory_cmd((char*)patterns[p].pattern, strlen(patterns[p].pattern),
+                                     addr, input, legacy);
+            create_memory_cmd(&tmpl[p], addr, input, compiled);
+
+            if(memcmp(legacy, compiled, AVR_CMD_SIZE) != 0) {
+                printf("Mismatch in %s at 0x%04x\n", patterns[p].name, addr);
+                failed = 1;
+                break;
+            }
+        }
+    }
+
+    printf("%-18s %14s %14s %8s\n", "pattern", "legacy ns/cmd", "compiled ns/cmd", "speedup");
+
+    for(_u32 p=0; p<PATTERNS_NUM; p++) {
+        char *pattern = (char*)patterns[p].pattern;
+        _u8 len = strlen(pattern);
+        double start, legacy_ns, compiled_ns;
+
+        start = now_ns();
+        for(_u32 i=0; i<BENCH_ITERATIONS; i++) {
+            legacy_create_memory_cmd(pattern, len, i, i, legacy);
+            sink ^= legacy[2];
+        }
+        legacy_ns = (now_ns() - start) / BENCH_ITERATIONS;
+
+        start = now_ns();
+        for(_u32 i=0; i<BENCH_ITERATIONS; i++) {
+            create_memory_cmd(&tmpl[p], i, i, compiled);
+            sink ^= compiled[2];
+        }
+        compiled_ns = (now_ns() - start) / BENCH_ITERATIONS;
+
+        printf("%-18s %14.1f %14.1f %7.1fx\n", patterns[p].name,
+               legacy_ns, compiled_ns, legacy_ns / compiled_ns);
+    }
+
+    (void)sink;
+    return failed;
+}
@@ -0,0 +1,140 @@
+/*
+ * Checks templates of built-in part table against ones compiled from
+ * datasheet patterns of serial programming instruction set.
+ *
+ * Build and run on host:
+ *      make -C test check
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "avr_parts.h"
+
+
+#define PATTERN_SIZE    128
+
+#define LOAD_EXT_ADDR_PATTERN   "01001101" "00000000" "a23a22a21a20a19a18a17a16" "xxxxxxxx"
+
+
+/* 16-bit address field where only bits lo..hi-1 are used */
+static char* add_address_field(char *p, _u8 lo, _u8 hi) {
+    for(int bit=15; bit>=0; bit--) {
+        if(bit >= lo && bit < hi) {
+            p += sprintf(p, "a%d", bit);
+        }
+        else {
+            *p++ = 'x';
+        }
+    }
+
+    return p;
+}
+
+
+static void build_pattern(char *pattern, const char *op, _u8 lo, _u8 hi, const char *last) {
+    char *p = pattern;
+
+    p += sprintf(p, "%s", op);
+    p = add_address_field(p, lo, hi);
+    sprintf(p, "%s", last);
+}
+
+
+static int check_cmd(const AvrPart *part, const char *name, const AvrCmdTemplate *tmpl,
+                     const char *op, _u8 lo, _u8 hi, const char *last)
+{
+    char pattern[PATTERN_SIZE];
+    AvrCmdTemplate compiled;
+
+    build_pattern(pattern, op, lo, hi, last);
+
+    if(compile_memory_cmd(pattern, strlen(pattern), &compiled) < 0) {
+        printf("%-12s %-18s pattern does not compile\n", part->name, name);
+        return 1;
+    }
+
+    if(memcmp(&compiled, tmpl, sizeof compiled) != 0) {
+        printf("%-12s %-18s differs from %s\n", part->name, name, pattern);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+static _u8 log2_of(_u32 value) {
+    _u8 bits = 0;
+
+    while((1UL << bits) < value) {
+        bits++;
+    }
+
+    return bits;
+}
+
+
+int main(void) {
+    int failed = 0;
+    const AvrPart *part;
+
+    for(_u16 i=0; (part = avr_parts_get(i)) != NULL; i++) {
+        const AvrMcuInfo *info = &part->info;
+        _u8 flash_bits = log2_of(part->flash_size / AVR_WORD_SIZE);
+        _u8 word_bits = (flash_bits > 16) ? 16 : flash_bits;
+        _u8 page_bits = log2_of(info->flash_page_size);
+        _u8 eeprom_bits = log2_of(part->eeprom_size);
+        AvrCmdTemplate rdy_bsy;
+        AvrCmdTemplate ext_addr;
+        int failed_before = failed;
+
+        failed += check_cmd(part, "flash load lo", &info->flash_load_lo,
+                            "01000000", 0, page_bits, "iiiiiiii");
+        failed += check_cmd(part, "flash load hi", &info->flash_load_hi,
+                            "01001000", 0, page_bits, "iiiiiiii");
+        failed += check_cmd(part, "flash read lo", &info->flash_read_lo,
+                            "00100000", 0, word_bits, "oooooooo");
+        failed += check_cmd(part, "flash read hi", &info->flash_read_hi,
+                            "00101000", 0, word_bits, "oooooooo");
+        failed += check_cmd(part, "flash write page", &info->flash_write_page,
+                            "01001100", page_bits, word_bits, "xxxxxxxx");
+        failed += check_cmd(part, "eeprom write", &info->eeprom_write,
+                            "11000000", 0, eeprom_bits, "iiiiiiii");
+        failed += check_cmd(part, "eeprom read", &info->eeprom_read,
+                            "10100000", 0, eeprom_bits, "oooooooo");
+
+        if(info->eeprom_page_size != 0) {
+            _u8 eeprom_page_bits = log2_of(info->eeprom_page_size);
+
+            failed += check_cmd(part, "eeprom load page", &info->eeprom_load_page,
+                                "11000001", 0, eeprom_page_bits, "iiiiiiii");
+            failed += check_cmd(part, "eeprom write page", &info->eeprom_write_page,
+                                "11000010", eeprom_page_bits, eeprom_bits, "xxxxxxxx");
+        }
+
+        compile_memory_cmd("11110000", 8, &rdy_bsy);
+        if(memcmp(&rdy_bsy, &info->poll_rdy_bsy, sizeof rdy_bsy) != 0) {
+            printf("%-12s %-18s differs\n", part->name, "poll rdy/bsy");
+            failed++;
+        }
+
+        if(info->ext_addr_supported != (flash_bits > 16)) {
+            printf("%-12s %-18s wrong support flag\n", part->name, "load ext addr");
+            failed++;
+        }
+
+        compile_memory_cmd(LOAD_EXT_ADDR_PATTERN, strlen(LOAD_EXT_ADDR_PATTERN), &ext_addr);
+        if(memcmp(&ext_addr, &info->load_ext_addr, sizeof ext_addr) != 0) {
+            printf("%-12s %-18s differs\n", part->name, "load ext addr");
+            failed++;
+        }
+
+        if(avr_parts_find(part->signature) != part) {
+            printf("%-12s signature is not unique\n", part->name);
+            failed++;
+        }
+
+        printf("%-12s %s\n", part->name, (failed != failed_before) ? "FAILED" : "ok");
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * Checks streaming Intel HEX parser: text split at every position,
+ * extended addresses, and rejection of broken records.
+ *
+ * Build and run on host:
+ *      make -C test check
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "ihex.h"
+
+
+#define IMAGE_SIZE      0x30000
+
+/*
+ * Data records below 64K, above it by extended linear address and by
+ * extended segment address. Record after end of file is ignored.
+ */
+static const char hex_text[] =
+    ":10010000214601360121470136007EFE09D2190140\r\n"
+    ":100110002146017E17C20001FF5F16002148011928\r\n"
+    ":020000040002F8\r\n"
+    ":04000000DEADBEEFC4\r\n"
+    ":020000021000EC\r\n"
+    ":0200100055AAEF\r\n"
+    ":00000001FF\r\n"
+    ":0400000012345678E8\r\n";
+
+static const _u8 expected_low[] = {
+    0x21, 0x46, 0x01, 0x36, 0x01, 0x21, 0x47, 0x01, 0x36, 0x00, 0x7E, 0xFE, 0x09, 0xD2, 0x19, 0x01,
+    0x21, 0x46, 0x01, 0x7E, 0x17, 0xC2, 0x00, 0x01, 0xFF, 0x5F, 0x16, 0x00, 0x21, 0x48, 0x01, 0x19
+};
+
+static const _u8 expected_high[] = {0xDE, 0xAD, 0xBE, 0xEF};
+static const _u8 expected_segment[] = {0x55, 0xAA};
+
+
+static _u8 image[IMAGE_SIZE];
+static _u32 bytes_received;
+
+
+static _i16 store_data(void *ctx, _u32 address, const _u8 *data, _u8 len) {
+    (void)ctx;
+
+    if(address + len > IMAGE_SIZE) {
+        return -1;
+    }
+
+    memcpy(image + address, data, len);
+    bytes_received += len;
+
+    return 0;
+}
+
+
+/* Feeds text in two pieces split at given position */
+static int check_split(const char *text, _u32 split) {
+    IhexParser parser;
+    _u32 len = strlen(text);
+
+    memset(image, 0xFF, sizeof image);
+    bytes_received = 0;
+    ihex_init(&parser, store_data, NULL);
+
+    if(ihex_feed(&parser, (const _u8*)text, split) < 0 ||
+       ihex_feed(&parser, (const _u8*)text + split, len - split) < 0)
+    {
+        printf("split at %u: parse error\n", split);
+        return 1;
+    }
+
+    if(!ihex_eof(&parser) ||
+       bytes_received != sizeof expected_low + sizeof expected_high + sizeof expected_segment ||
+       memcmp(image + 0x100, expected_low, sizeof expected_low) != 0 ||
+       memcmp(image + 0x20000, expected_high, sizeof expected_high) != 0 ||
+       memcmp(image + 0x10010, expected_segment, sizeof expected_segment) != 0)
+    {
+        printf("split at %u: wrong data\n", split);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+static int check_rejected(const char *name, const char *text) {
+    IhexParser parser;
+
+    ihex_init(&parser, store_data, NULL);
+
+    if(ihex_feed(&parser, (const _u8*)text, strlen(text)) == 0) {
+        printf("%-20s FAILED, accepted\n", name);
+        return 1;
+    }
+
+    printf("%-20s ok\n", name);
+    return 0;
+}
+
+
+int main(void) {
+    int failed = 0;
+    _u32 len = strlen(hex_text);
+
+    for(_u32 split=0; split<=len; split++) {
+        failed += check_split(hex_text, split);
+    }
+
+    printf("%-20s %s\n", "split records", failed ? "FAILED" : "ok");
+
+    failed += check_rejected("bad checksum", ":0400000012345678E9\r\n");
+    failed += check_rejected("bad digit", ":04000000123G5678E8\r\n");
+    failed += check_rejected("text outside record", "x:00000001FF\r\n");
+    failed += check_rejected("unknown record type", ":00000006FA\r\n");
+
+    return failed ? 1 : 0;
+}
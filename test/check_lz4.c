@@ -0,0 +1,79 @@
+/*
+ * Checks LZ4 block decoder on hand-made blocks, including overlapping
+ * matches and malformed input which must not touch memory outside
+ * of buffers.
+ *
+ * Build and run on host:
+ *      make -C test check
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "lz4.h"
+
+
+#define OUT_SIZE        512
+
+
+/* Literals "abcd", match of 8 at offset 4, last literals "xy" */
+static const _u8 repeat_block[] = {
+    0x44, 'a', 'b', 'c', 'd', 0x04, 0x00,
+    0x20, 'x', 'y'
+};
+
+/* One 0xFF literal, match of 299 at offset 1 with extra length bytes, then 0x00 */
+static const _u8 run_block[] = {
+    0x1F, 0xFF, 0x01, 0x00, 0xFF, 0x19,
+    0x10, 0x00
+};
+
+static const _u8 zero_offset_block[] = {0x44, 'a', 'b', 'c', 'd', 0x00, 0x00};
+static const _u8 far_offset_block[] = {0x44, 'a', 'b', 'c', 'd', 0x05, 0x00};
+static const _u8 short_literals_block[] = {0x50, 'a', 'b', 'c', 'd'};
+static const _u8 cut_offset_block[] = {0x44, 'a', 'b', 'c', 'd', 0x04};
+static const _u8 cut_length_block[] = {0xF0, 0xFF};
+
+
+static int check_block(const char *name, const _u8 *block, _u32 len,
+                       const _u8 *expected, _i32 expected_len)
+{
+    _u8 out[OUT_SIZE];
+    _i32 res = lz4_decompress_block(block, len, out, sizeof out);
+
+    if(res != expected_len || (res > 0 && memcmp(out, expected, res) != 0)) {
+        printf("%-20s FAILED, got %d\n", name, res);
+        return 1;
+    }
+
+    printf("%-20s ok\n", name);
+    return 0;
+}
+
+
+int main(void) {
+    int failed = 0;
+    _u8 run[301];
+    _u8 out[8];
+
+    memset(run, 0xFF, 300);
+    run[300] = 0x00;
+
+    failed += check_block("repeat", repeat_block, sizeof repeat_block,
+                          (const _u8*)"abcdabcdabcdxy", 14);
+    failed += check_block("overlapping run", run_block, sizeof run_block, run, sizeof run);
+    failed += check_block("zero offset", zero_offset_block, sizeof zero_offset_block, NULL, -1);
+    failed += check_block("offset before start", far_offset_block, sizeof far_offset_block, NULL, -1);
+    failed += check_block("literals past end", short_literals_block, sizeof short_literals_block, NULL, -1);
+    failed += check_block("cut offset", cut_offset_block, sizeof cut_offset_block, NULL, -1);
+    failed += check_block("cut length", cut_length_block, sizeof cut_length_block, NULL, -1);
+
+    if(lz4_decompress_block(run_block, sizeof run_block, out, sizeof out) != -1) {
+        printf("%-20s FAILED\n", "output overflow");
+        failed++;
+    }
+    else {
+        printf("%-20s ok\n", "output overflow");
+    }
+
+    return failed ? 1 : 0;
+}
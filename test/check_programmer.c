@@ -0,0 +1,405 @@
+/*
+ * Runs programmer.c against simulated targets: enters PGM mode, ramps
+ * SPI clock, erases, programs and verifies flash and EEPROM, and prints
+ * throughput in simulated time. Fails on wrong memory contents or on
+ * instructions sent while target was busy. Smaller runs cover unaligned
+ * ranges, blank pages skipped after erase and access without MCU info.
+ *
+ * Build and run on host:
+ *      make -C test check
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "programmer.h"
+#include "packets.h"
+#include "avr_parts.h"
+#include "crc.h"
+#include "config.h"
+
+#include "avr_sim.h"
+
+
+/* Part of flash filled with program, the rest is left blank */
+#define IMAGE_FILL_PERCENT  60
+#define EEPROM_BYTES        256
+#define READ_BYTES          4096
+
+/* EEPROM range starting and ending inside EEPROM pages */
+#define EEPROM_UNALIGNED_START  3
+#define EEPROM_UNALIGNED_BYTES  70
+
+#define NS_PER_S            1000000000ULL
+
+
+typedef struct {
+    const char  *name;
+    _u32        fck_hz;
+} SimPartRun;
+
+
+static const SimPartRun runs[] = {
+    {"ATmega328P",  16000000},
+    {"ATmega2560",  16000000},
+    {"ATmega8",     8000000}
+};
+
+
+static _u8 read_buf[READ_BYTES];
+static _u32 page_crcs[PL_PAGE_CRC_MAX_PAGES];
+
+/* PageCrc reply of the most pages must fit packet buffer */
+typedef char page_crc_reply_fits[
+    (PL_PAGE_CRC_DATA_OFFSET + PL_PAGE_CRC_MAX_PAGES*4 <= sizeof ((Packet*)0)->packet_data) ? 1 : -1];
+
+
+static const AvrPart* find_part(const char *name) {
+    const AvrPart *part;
+
+    for(_u16 i=0; (part = avr_parts_get(i)) != NULL; i++) {
+        if(strcmp(part->name, name) == 0) {
+            return part;
+        }
+    }
+
+    return NULL;
+}
+
+
+static double bytes_per_s(_u32 bytes, unsigned long long ns) {
+    return ns ? (double)bytes * NS_PER_S / ns : 0;
+}
+
+
+static void make_image(_u8 *image, _u32 size, _u32 used) {
+    for(_u32 i=0; i<size; i++) {
+        image[i] = (i < used) ? rand() & 0xFF : 0xFF;
+    }
+}
+
+
+static int program_image(_u8 *image, _u32 size, AvrMemoryType type) {
+    for(_u32 offset=0; offset<size; offset+=IMAGE_CHUNK_SIZE) {
+        AvrProgMemData data = {
+            .start_address = (type == MEMORY_FLASH) ? offset / AVR_WORD_SIZE : offset,
+            .memory_type = type,
+            .data_len = (size - offset < IMAGE_CHUNK_SIZE) ? size - offset : IMAGE_CHUNK_SIZE,
+            .data = image + offset
+        };
+
+        if(programmer_program_memory(&data) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* Targets marked in skip_mask are disconnected and must be dropped */
+static int run_part(const SimPartRun *run, _u8 targets_num, _u8 skip_mask) {
+    const AvrPart *part = find_part(run->name);
+    const AvrSimStats *stats = avr_sim_stats();
+    AvrMcuInfo info;
+    AvrReadMemData range;
+    unsigned long long start;
+    _u32 used, crc, rate, pages;
+    _u8 *image, eeprom[EEPROM_BYTES];
+    _u8 expected_mask = ((1 << targets_num) - 1) & ~skip_mask;
+    int failed = 0;
+
+    if(part == NULL) {
+        printf("%-12s unknown part\n", run->name);
+        return 1;
+    }
+
+    info = part->info;
+    info.fck_khz = run->fck_hz / 1000;
+
+    avr_sim_init(part, run->fck_hz, targets_num);
+    for(_u8 t=0; t<targets_num; t++) {
+        if(skip_mask & (1 << t)) {
+            avr_sim_disconnect(t);
+        }
+    }
+
+    programmer_set_mcu_info(&info);
+    programmer_set_targets((1 << targets_num) - 1);
+
+    if(programmer_enable_pgm_mode() < 0 ||
+       programmer_match_signatures(part->signature) < 0 ||
+       programmer_live_targets() != expected_mask)
+    {
+        printf("%-12s x%u: wrong targets in PGM mode\n", run->name, targets_num);
+        avr_sim_free();
+        return 1;
+    }
+
+    rate = programmer_ramp_spi_rate();
+    if(programmer_chip_erase() < 0) {
+        printf("%-12s chip erase failed\n", run->name);
+        avr_sim_free();
+        return 1;
+    }
+
+    used = (part->flash_size / 100 * IMAGE_FILL_PERCENT) & ~(AVR_WORD_SIZE - 1);
+    image = malloc(part->flash_size);
+    make_image(image, part->flash_size, used);
+
+    /* Flash */
+    avr_sim_reset_stats();
+    start = stats->time_ns;
+    failed |= program_image(image, part->flash_size, MEMORY_FLASH);
+    unsigned long long flash_ns = stats->time_ns - start;
+    pages = stats->flash_page_writes / __builtin_popcount(expected_mask);
+    _u32 flash_instructions = stats->instructions;
+    failed |= stats->busy_violations != 0;
+
+    range.start_address = 0;
+    range.bytes_to_read = part->flash_size;
+    range.mem_t = MEMORY_FLASH;
+
+    start = stats->time_ns;
+    failed |= programmer_memory_crc(&range, &crc, NULL, 0) < 0;
+    failed |= crc != crc32_update(CRC32_INIT, image, part->flash_size);
+    unsigned long long crc_ns = stats->time_ns - start;
+
+    /* As many pages as PageCrc reply may carry */
+    _u32 page_bytes = (_u32)info.flash_page_size * AVR_WORD_SIZE;
+    _u16 crc_pages = part->flash_size / page_bytes;
+
+    if(crc_pages > PL_PAGE_CRC_MAX_PAGES) {
+        crc_pages = PL_PAGE_CRC_MAX_PAGES;
+    }
+
+    failed |= programmer_flash_page_crcs(0, crc_pages, page_crcs) < 0;
+    for(_u16 p=0; p<crc_pages; p++) {
+        failed |= page_crcs[p] != crc32_update(CRC32_INIT, image + p*page_bytes, page_bytes);
+    }
+
+    range.bytes_to_read = READ_BYTES;
+    start = stats->time_ns;
+    failed |= programmer_read_memory(&range, read_buf) != READ_BYTES;
+    failed |= memcmp(read_buf, image, READ_BYTES) != 0;
+    unsigned long long read_ns = stats->time_ns - start;
+
+    /* EEPROM */
+    make_image(eeprom, EEPROM_BYTES, EEPROM_BYTES);
+    avr_sim_reset_stats();
+    start = stats->time_ns;
+    failed |= program_image(eeprom, EEPROM_BYTES, MEMORY_EEPROM);
+    unsigned long long eeprom_ns = stats->time_ns - start;
+    failed |= stats->busy_violations != 0;
+
+    for(_u8 t=0; t<targets_num; t++) {
+        if(expected_mask & (1 << t)) {
+            failed |= memcmp(avr_sim_flash(t), image, part->flash_size) != 0;
+            failed |= memcmp(avr_sim_eeprom(t), eeprom, EEPROM_BYTES) != 0;
+        }
+    }
+
+    /* Host leaves unimplemented lock and extended fuse bits 0 */
+    _u8 fuse_values[AVR_FUSES_NUM] = {
+        [AVR_FUSE_LOCK] = part->fuse_bits[AVR_FUSE_LOCK],
+        [AVR_FUSE_EXT]  = 0x05 & part->fuse_bits[AVR_FUSE_EXT]
+    };
+    _u8 fuses_failed;
+
+    failed |= programmer_write_fuses((1 << AVR_FUSE_LOCK) | (1 << AVR_FUSE_EXT),
+                                     fuse_values, &fuses_failed) < 0;
+    failed |= fuses_failed != 0;
+
+    failed |= programmer_live_targets() != expected_mask;
+
+    printf("%-12s x%u  SPI %7u Hz  flash %6.0f B/s  %4.1f instr/page  "
+           "verify %6.0f B/s  read %6.0f B/s  EEPROM %5.0f B/s  %s\n",
+           run->name, targets_num, rate,
+           bytes_per_s(part->flash_size, flash_ns),
+           pages ? (double)flash_instructions / pages : 0,
+           bytes_per_s(part->flash_size, crc_ns),
+           bytes_per_s(READ_BYTES, read_ns),
+           bytes_per_s(EEPROM_BYTES, eeprom_ns),
+           failed ? "FAILED" : "ok");
+
+    free(image);
+    avr_sim_free();
+
+    return failed;
+}
+
+
+/*
+ * Targets left out of the mask share SCK and MOSI, so they must be
+ * released from reset and keep their flash.
+ */
+static int run_unmasked(const SimPartRun *run) {
+    const AvrPart *part = find_part(run->name);
+    AvrMcuInfo info = part->info;
+    _u8 image[IMAGE_CHUNK_SIZE];
+    int failed = 0;
+
+    info.fck_khz = run->fck_hz / 1000;
+    make_image(image, sizeof image, sizeof image);
+
+    avr_sim_init(part, run->fck_hz, 2);
+    programmer_set_mcu_info(&info);
+    programmer_set_targets(0x01);
+
+    failed |= programmer_enable_pgm_mode() < 0;
+    failed |= programmer_chip_erase() < 0;
+    failed |= program_image(image, sizeof image, MEMORY_FLASH) < 0;
+    failed |= memcmp(avr_sim_flash(0), image, sizeof image) != 0;
+
+    for(_u32 i=0; i<sizeof image; i++) {
+        failed |= avr_sim_flash(1)[i] != 0xFF;
+    }
+
+    printf("%-12s x1 of 2: unmasked target %s\n", run->name,
+           failed ? "programmed, FAILED" : "untouched, ok");
+
+    avr_sim_free();
+    return failed;
+}
+
+
+/*
+ * Flash range starts mid-page in the upper half of flash and ends
+ * in a page whose part is blank, so after chip erase that page is
+ * not written at all. EEPROM range is unaligned too.
+ */
+static int run_unaligned(const SimPartRun *run) {
+    const AvrPart *part = find_part(run->name);
+    const AvrSimStats *stats = avr_sim_stats();
+    AvrMcuInfo info = part->info;
+    _u32 page_bytes = (_u32)info.flash_page_size * AVR_WORD_SIZE;
+    _u32 start = part->flash_size / 2 + 3*page_bytes + 10;
+    _u32 len = 2*page_bytes + 20;
+    _u32 first_len = 4*page_bytes - (start - part->flash_size / 2);
+    _u8 *data = malloc(len);
+    _u8 eeprom[EEPROM_UNALIGNED_BYTES];
+    AvrReadMemData range;
+    _u32 crc;
+    int failed = 0;
+
+    info.fck_khz = run->fck_hz / 1000;
+
+    /* Blank words inside the full page, the last partial page is blank */
+    make_image(data, len, len - 30);
+    memset(data + page_bytes, 0xFF, 2*AVR_WORD_SIZE);
+    make_image(eeprom, sizeof eeprom, sizeof eeprom);
+
+    avr_sim_init(part, run->fck_hz, 1);
+    programmer_set_mcu_info(&info);
+    programmer_set_targets(0x01);
+
+    failed |= programmer_enable_pgm_mode() < 0;
+    failed |= programmer_chip_erase() < 0;
+
+    /* Second piece starts on page boundary, as chunks of a stream do */
+    AvrProgMemData pieces[] = {
+        {start / AVR_WORD_SIZE, MEMORY_FLASH, first_len, data},
+        {(start + first_len) / AVR_WORD_SIZE, MEMORY_FLASH, len - first_len, data + first_len},
+        {EEPROM_UNALIGNED_START, MEMORY_EEPROM, sizeof eeprom, eeprom}
+    };
+
+    avr_sim_reset_stats();
+    for(_u8 i=0; i<sizeof pieces / sizeof pieces[0]; i++) {
+        failed |= programmer_program_memory(&pieces[i]) < 0;
+    }
+    failed |= stats->flash_page_writes != 2;
+    failed |= stats->busy_violations != 0;
+
+    for(_u32 i=0; i<part->flash_size; i++) {
+        _u8 expected = (i >= start && i < start + len) ? data[i - start] : 0xFF;
+        failed |= avr_sim_flash(0)[i] != expected;
+    }
+
+    for(_u32 i=0; i<part->eeprom_size; i++) {
+        _u8 expected = 0xFF;
+
+        if(i >= EEPROM_UNALIGNED_START && i < EEPROM_UNALIGNED_START + sizeof eeprom) {
+            expected = eeprom[i - EEPROM_UNALIGNED_START];
+        }
+        failed |= avr_sim_eeprom(0)[i] != expected;
+    }
+
+    range.start_address = start / AVR_WORD_SIZE;
+    range.bytes_to_read = len;
+    range.mem_t = MEMORY_FLASH;
+
+    failed |= programmer_read_memory(&range, read_buf) != len;
+    failed |= memcmp(read_buf, data, len) != 0;
+    failed |= programmer_memory_crc(&range, &crc, NULL, 0) < 0;
+    failed |= crc != crc32_update(CRC32_INIT, data, len);
+
+    range.start_address = EEPROM_UNALIGNED_START;
+    range.bytes_to_read = sizeof eeprom;
+    range.mem_t = MEMORY_EEPROM;
+
+    failed |= programmer_read_memory(&range, read_buf) != sizeof eeprom;
+    failed |= memcmp(read_buf, eeprom, sizeof eeprom) != 0;
+
+    printf("%-12s unaligned flash and EEPROM ranges %s\n", run->name, failed ? "FAILED" : "ok");
+
+    free(data);
+    avr_sim_free();
+    return failed;
+}
+
+
+/* Memory access without MCU info fails instead of faulting */
+static int run_no_info(const SimPartRun *run) {
+    const AvrPart *part = find_part(run->name);
+    _u8 data[16];
+    AvrProgMemData prog = {0, MEMORY_FLASH, sizeof data, data};
+    AvrReadMemData range = {0, sizeof data, MEMORY_FLASH};
+    _u32 crc;
+    int failed = 0;
+
+    make_image(data, sizeof data, sizeof data);
+
+    avr_sim_init(part, run->fck_hz, 1);
+    programmer_set_mcu_info(NULL);
+    programmer_set_targets(0x01);
+
+    failed |= programmer_enable_pgm_mode() < 0;
+    failed |= programmer_ramp_spi_rate() >= 0;
+    failed |= programmer_program_memory(&prog) >= 0;
+    failed |= programmer_read_memory(&range, read_buf) >= 0;
+    failed |= programmer_memory_crc(&range, &crc, NULL, 0) >= 0;
+    failed |= programmer_flash_page_crcs(0, 1, page_crcs) >= 0;
+
+    for(_u32 i=0; i<sizeof data; i++) {
+        failed |= avr_sim_flash(0)[i] != 0xFF;
+    }
+
+    printf("%-12s no MCU info: memory access refused %s\n", run->name, failed ? "FAILED" : "ok");
+
+    avr_sim_free();
+    return failed;
+}
+
+
+int main(void) {
+    int failed = 0;
+
+    crc32_init();
+    srand(1);
+
+    for(_u32 i=0; i<sizeof runs / sizeof runs[0]; i++) {
+        failed |= run_part(&runs[i], 1, 0);
+    }
+
+    /* Gang with target which does not answer */
+    failed |= run_part(&runs[0], 3, 0x02);
+    failed |= run_unmasked(&runs[0]);
+
+    for(_u32 i=0; i<sizeof runs / sizeof runs[0]; i++) {
+        failed |= run_unaligned(&runs[i]);
+    }
+
+    failed |= run_no_info(&runs[0]);
+
+    return failed ? 1 : 0;
+}
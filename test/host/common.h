@@ -0,0 +1,8 @@
+#ifndef HOST_COMMON_H_INCLUDED
+#define HOST_COMMON_H_INCLUDED
+
+/* Host stand-in for SDK common.h */
+
+#define ERR_PRINT(x)
+
+#endif // HOST_COMMON_H_INCLUDED
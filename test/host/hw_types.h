@@ -0,0 +1,9 @@
+#ifndef HOST_HW_TYPES_H_INCLUDED
+#define HOST_HW_TYPES_H_INCLUDED
+
+/*
+ * Host stand-in for driverlib header. Firmware sources include it
+ * but use nothing of it on host.
+ */
+
+#endif // HOST_HW_TYPES_H_INCLUDED
@@ -0,0 +1,35 @@
+#ifndef HOST_OSI_H_INCLUDED
+#define HOST_OSI_H_INCLUDED
+
+/*
+ * Host stand-in for OSI header. There are no tasks on host, so only
+ * types, sleep and locks are given. Sleep is provided by simulator
+ * and advances its clock, locks do nothing.
+ */
+
+#include "simplelink.h"
+
+typedef void*       OsiMsgQ_t;
+typedef void*       OsiLockObj_t;
+typedef void*       OsiSyncObj_t;
+typedef void*       OsiTaskHandle;
+typedef _u32        OsiTime_t;
+
+#define OSI_OK              0
+#define OSI_WAIT_FOREVER    (0xFFFFFFFF)
+#define OSI_NO_WAIT         (0)
+
+void osi_Sleep(unsigned int ms);
+
+static inline int osi_LockObjLock(OsiLockObj_t *lock, OsiTime_t timeout) {
+    (void)lock;
+    (void)timeout;
+    return OSI_OK;
+}
+
+static inline int osi_LockObjUnlock(OsiLockObj_t *lock) {
+    (void)lock;
+    return OSI_OK;
+}
+
+#endif // HOST_OSI_H_INCLUDED
@@ -0,0 +1,27 @@
+#ifndef HOST_SIMPLELINK_H_INCLUDED
+#define HOST_SIMPLELINK_H_INCLUDED
+
+/*
+ * Host stand-in for SimpleLink header. Provides only the basic
+ * types so firmware sources can be built for benchmarks on PC.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t     _u8;
+typedef int8_t      _i8;
+typedef uint16_t    _u16;
+typedef int16_t     _i16;
+typedef uint32_t    _u32;
+typedef int32_t     _i32;
+
+#ifndef TRUE
+#define TRUE    1
+#endif
+
+#ifndef FALSE
+#define FALSE   0
+#endif
+
+#endif // HOST_SIMPLELINK_H_INCLUDED